@@ -0,0 +1,80 @@
+// MetricsCollector on the request path (recording, from several threads at
+// once) and on the scrape path (rendering the Prometheus text).
+//
+//   ./metrics_bench --benchmark_out=metrics.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include "metrics.hpp"
+
+namespace {
+
+MetricsCollector& collector() {
+    static MetricsCollector metrics;
+    return metrics;
+}
+
+// Spread samples over the buckets like real latencies would
+int64_t sample(uint64_t i) {
+    return static_cast<int64_t>(100 + (i * 2654435761u) % 200000);
+}
+
+void BM_RecordRequest(benchmark::State& state) {
+    MetricsCollector& metrics = collector();
+    uint64_t i = static_cast<uint64_t>(state.thread_index()) << 32;
+    for (auto _ : state) {
+        metrics.record_request(ResultSource::processed, sample(i), sample(i + 1));
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_RecordStage(benchmark::State& state) {
+    MetricsCollector& metrics = collector();
+    StageLabels labels = MetricsCollector::stage_labels("jpeg", "webp", 1024 * 1024);
+    uint64_t i = static_cast<uint64_t>(state.thread_index()) << 32;
+    for (auto _ : state) {
+        metrics.record_stage(Stage::decode, labels, sample(i++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_RecordFailure(benchmark::State& state) {
+    MetricsCollector& metrics = collector();
+    uint64_t i = static_cast<uint64_t>(state.thread_index()) << 32;
+    for (auto _ : state) {
+        metrics.record_failure(FailureClass::decode, sample(i++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// A collector that has seen a realistic spread of label sets
+void BM_Scrape(benchmark::State& state) {
+    MetricsCollector metrics;
+    const char* inputs[] = {"jpeg", "png", "webp"};
+    const char* outputs[] = {"jpeg", "webp", "avif"};
+    for (uint64_t i = 0; i < 100000; ++i) {
+        StageLabels labels = MetricsCollector::stage_labels(inputs[i % 3], outputs[(i / 3) % 3], (i % 4) << 20);
+        metrics.record_request(ResultSource::processed, sample(i), sample(i + 1));
+        metrics.record_stage(static_cast<Stage>(i % 6), labels, sample(i));
+        metrics.record_bytes(labels, 1 << 20, 1 << 14);
+    }
+
+    size_t size = 0;
+    for (auto _ : state) {
+        std::string text = metrics.get_prometheus_metrics();
+        size = text.size();
+        benchmark::DoNotOptimize(text.data());
+    }
+    state.counters["output_KB"] = static_cast<double>(size) / 1024;
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+
+BENCHMARK(BM_RecordRequest)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_RecordStage)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_RecordFailure)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_Scrape)->Unit(benchmark::kMicrosecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,82 @@
+// Upload body extraction as the server runs it: request_body's reader
+// copying, multipart-parsing and hashing a body in socket-sized chunks.
+// raw is the same reader without multipart, for comparison.
+//
+//   ./multipart_bench --benchmark_out=multipart.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "request_body.hpp"
+
+namespace {
+
+const std::string BOUNDARY = "----thumbnailgenbench7MA4YWxkTrZu0gW";
+
+// A form with a small text field ahead of the file, as browsers send it
+std::string make_body(size_t file_size, bool multipart) {
+    std::mt19937 rng(42);
+    std::string file(file_size, '\0');
+    for (auto& c : file) c = static_cast<char>(rng());
+    if (!multipart) {
+        return file;
+    }
+    std::string body;
+    body += "--" + BOUNDARY + "\r\n";
+    body += "Content-Disposition: form-data; name=\"caption\"\r\n\r\n";
+    body += "holiday photo\r\n";
+    body += "--" + BOUNDARY + "\r\n";
+    body += "Content-Disposition: form-data; name=\"file\"; filename=\"photo.jpg\"\r\n";
+    body += "Content-Type: image/jpeg\r\n\r\n";
+    body += file;
+    body += "\r\n--" + BOUNDARY + "--\r\n";
+    return body;
+}
+
+// Args: body size in KiB, chunk size in KiB
+void run(benchmark::State& state, bool multipart) {
+    std::string body = make_body(static_cast<size_t>(state.range(0)) * 1024, multipart);
+    size_t chunk = static_cast<size_t>(state.range(1)) * 1024;
+    boost::beast::http::request_header<> header;
+
+    for (auto _ : state) {
+        request_body::value_type value;
+        if (multipart) value.expect_multipart(BOUNDARY);
+        request_body::reader reader(header, value);
+        boost::beast::error_code ec;
+        reader.init(body.size(), ec);
+        for (size_t offset = 0; offset < body.size(); offset += chunk) {
+            size_t n = std::min(chunk, body.size() - offset);
+            reader.put(boost::asio::const_buffer(body.data() + offset, n), ec);
+        }
+        reader.finish(ec);
+        if (multipart && !value.multipart()->file_found()) {
+            state.SkipWithError("file part not found");
+            break;
+        }
+        benchmark::DoNotOptimize(value.content_hash());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+
+void BM_Multipart(benchmark::State& state) { run(state, true); }
+void BM_Raw(benchmark::State& state) { run(state, false); }
+
+void bodies(benchmark::internal::Benchmark* b) {
+    for (int kib : {64, 1024, 8 * 1024, 20 * 1024}) {
+        for (int chunk : {4, 64}) {
+            b->Args({kib, chunk});
+        }
+    }
+    b->ArgNames({"KiB", "chunk_KiB"})->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK(BM_Multipart)->Apply(bodies);
+BENCHMARK(BM_Raw)->Apply(bodies);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,124 @@
+// End-to-end ThumbnailProcessor::create_thumbnail across a matrix of
+// synthetic inputs (JPEG, PNG, WebP at 0.3-24 MP) and every output format
+// and size this libvips build supports. Decode and encode time per call
+// are reported as counters alongside the wall time.
+//
+//   ./pipeline_bench --benchmark_out=pipeline.json --benchmark_out_format=json
+//   ./pipeline_bench --benchmark_filter='in:jpeg/MP:12/'
+
+#include <benchmark/benchmark.h>
+#include <vips/vips.h>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "thumbnail_processor.hpp"
+
+namespace {
+
+const char* const INPUT_FORMATS[] = {"jpeg", "png", "webp"};
+const char* const MEGAPIXELS[] = {"0.3", "2", "12", "24"};
+const int EDGES[] = {128, 512};
+
+// 4:3 noise; noise defeats entropy coding, so the files are realistic in
+// size for their resolution and expensive to decode
+DecodedImage make_image(double megapixels) {
+    int width = static_cast<int>(std::sqrt(megapixels * 1e6 * 4 / 3));
+    int height = width * 3 / 4;
+
+    VipsImage* noise = nullptr;
+    VipsImage* grey = nullptr;
+    VipsImage* rgb = nullptr;
+    if (vips_gaussnoise(&noise, width, height, "mean", 128.0, "sigma", 40.0, nullptr) ||
+        vips_cast_uchar(noise, &grey, nullptr)) {
+        throw std::runtime_error(vips_error_buffer());
+    }
+    VipsImage* bands[] = {grey, grey, grey};
+    int failed = vips_bandjoin(bands, &rgb, 3, nullptr);
+    g_object_unref(grey);
+    g_object_unref(noise);
+    if (failed) {
+        throw std::runtime_error(vips_error_buffer());
+    }
+    return DecodedImage(rgb, [](VipsImage* p) { g_object_unref(p); });
+}
+
+// Inputs are built on first use so a filtered run only pays for what it needs
+const std::vector<uint8_t>& input_for(ThumbnailProcessor& processor, const std::string& format,
+                                      const std::string& megapixels) {
+    static std::map<std::pair<std::string, std::string>, std::vector<uint8_t>> cache;
+    auto key = std::make_pair(format, megapixels);
+    auto it = cache.find(key);
+    if (it == cache.end()) {
+        auto encoded = processor.encode(make_image(std::stod(megapixels)), format, EncodeOptions{});
+        it = cache.emplace(key, std::vector<uint8_t>(encoded->data(), encoded->data() + encoded->size())).first;
+    }
+    return it->second;
+}
+
+void BM_CreateThumbnail(benchmark::State& state, ThumbnailProcessor& processor, std::string input_format,
+                        std::string megapixels, std::string output_format, int edge) {
+    const std::vector<uint8_t>* input = nullptr;
+    try {
+        input = &input_for(processor, input_format, megapixels);
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+
+    ThumbnailOptions options;
+    options.width = edge;
+    options.height = edge;
+    options.format = output_format;
+
+    double decode_us = 0;
+    double encode_us = 0;
+    size_t output_size = 0;
+    for (auto _ : state) {
+        StageTimings timings;
+        try {
+            auto thumbnail = processor.create_thumbnail(input->data(), input->size(), options, &timings);
+            output_size = thumbnail->size();
+        } catch (const std::exception& e) {
+            state.SkipWithError(e.what());
+            break;
+        }
+        decode_us += static_cast<double>(timings.decode_microseconds);
+        encode_us += static_cast<double>(timings.encode_microseconds);
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input->size()));
+    state.counters["input_MB"] = static_cast<double>(input->size()) / (1024 * 1024);
+    state.counters["output_KB"] = static_cast<double>(output_size) / 1024;
+    state.counters["decode_ms"] = benchmark::Counter(decode_us / 1000, benchmark::Counter::kAvgIterations);
+    state.counters["encode_ms"] = benchmark::Counter(encode_us / 1000, benchmark::Counter::kAvgIterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // Initialises libvips and probes which output formats are available
+    ThumbnailProcessor processor;
+
+    for (const char* input_format : INPUT_FORMATS) {
+        for (const char* megapixels : MEGAPIXELS) {
+            for (const auto& output_format : processor.formats()) {
+                for (int edge : EDGES) {
+                    std::string name = std::string("create_thumbnail/in:") + input_format + "/MP:" + megapixels +
+                                       "/out:" + output_format + "/edge:" + std::to_string(edge);
+                    benchmark::RegisterBenchmark(name.c_str(), BM_CreateThumbnail, std::ref(processor),
+                                                 input_format, megapixels, output_format, edge)
+                        ->Unit(benchmark::kMillisecond);
+                }
+            }
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Compares the old full-decode pipeline (vips_image_new_from_buffer +
+// vips_thumbnail_image with linear light) against shrink-on-load via
+// vips_thumbnail_buffer, on camera-sized JPEGs.
+//
+//   ./processor_bench --benchmark_out=results.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <vips/vips.h>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Noise defeats JPEG's entropy coding, so these files are realistic in
+// size for their resolution and expensive to decode
+std::vector<uint8_t> make_jpeg(int megapixels) {
+    int width = 4 * 1024;
+    int height = megapixels * 1024 * 1024 / width;
+
+    VipsImage* noise = nullptr;
+    VipsImage* grey = nullptr;
+    VipsImage* rgb = nullptr;
+    void* buffer = nullptr;
+    size_t size = 0;
+    auto release = [&]() {
+        for (VipsImage* image : {rgb, grey, noise}) {
+            if (image) g_object_unref(image);
+        }
+    };
+
+    VipsImage* bands[3] = {};
+    bool failed = vips_gaussnoise(&noise, width, height, "mean", 128.0, "sigma", 40.0, nullptr) ||
+                  vips_cast_uchar(noise, &grey, nullptr);
+    if (!failed) {
+        bands[0] = bands[1] = bands[2] = grey;
+        failed = vips_bandjoin(bands, &rgb, 3, nullptr) ||
+                 vips_jpegsave_buffer(rgb, &buffer, &size, "Q", 90, nullptr);
+    }
+    if (failed) {
+        std::string error = vips_error_buffer();
+        release();
+        throw std::runtime_error(error);
+    }
+
+    std::vector<uint8_t> jpeg(static_cast<uint8_t*>(buffer), static_cast<uint8_t*>(buffer) + size);
+    g_free(buffer);
+    release();
+    return jpeg;
+}
+
+const std::vector<uint8_t>& jpeg_for(int megapixels) {
+    static std::map<int, std::vector<uint8_t>> cache;
+    auto it = cache.find(megapixels);
+    if (it == cache.end()) {
+        it = cache.emplace(megapixels, make_jpeg(megapixels)).first;
+    }
+    return it->second;
+}
+
+void encode_and_free(benchmark::State& state, VipsImage* thumbnail) {
+    void* buffer = nullptr;
+    size_t size = 0;
+    if (vips_jpegsave_buffer(thumbnail, &buffer, &size, "Q", 90, "strip", true, nullptr)) {
+        state.SkipWithError(vips_error_buffer());
+    }
+    g_free(buffer);
+    g_object_unref(thumbnail);
+}
+
+void report_input(benchmark::State& state, size_t input_size) {
+    state.counters["input_MB"] = static_cast<double>(input_size) / (1024 * 1024);
+}
+
+// Args: megapixels, thumbnail edge
+void BM_FullDecode(benchmark::State& state) {
+    const auto& jpeg = jpeg_for(static_cast<int>(state.range(0)));
+    int edge = static_cast<int>(state.range(1));
+
+    for (auto _ : state) {
+        VipsImage* input = vips_image_new_from_buffer(jpeg.data(), jpeg.size(), "", nullptr);
+        VipsImage* thumbnail = nullptr;
+        if (!input || vips_thumbnail_image(input, &thumbnail, edge,
+                                           "height", edge,
+                                           "crop", VIPS_INTERESTING_CENTRE,
+                                           "linear", true,
+                                           "no_rotate", true,
+                                           nullptr)) {
+            state.SkipWithError(vips_error_buffer());
+            if (input) g_object_unref(input);
+            break;
+        }
+        encode_and_free(state, thumbnail);
+        g_object_unref(input);
+    }
+    report_input(state, jpeg.size());
+}
+
+void BM_ShrinkOnLoad(benchmark::State& state) {
+    const auto& jpeg = jpeg_for(static_cast<int>(state.range(0)));
+    int edge = static_cast<int>(state.range(1));
+
+    for (auto _ : state) {
+        VipsImage* thumbnail = nullptr;
+        if (vips_thumbnail_buffer(const_cast<uint8_t*>(jpeg.data()), jpeg.size(),
+                                  &thumbnail, edge,
+                                  "height", edge,
+                                  "crop", VIPS_INTERESTING_CENTRE,
+                                  "no_rotate", true,
+                                  nullptr)) {
+            state.SkipWithError(vips_error_buffer());
+            break;
+        }
+        encode_and_free(state, thumbnail);
+    }
+    report_input(state, jpeg.size());
+}
+
+void large_jpegs(benchmark::internal::Benchmark* b) {
+    for (int megapixels : {12, 24}) {
+        for (int edge : {64, 256}) {
+            b->Args({megapixels, edge});
+        }
+    }
+    b->ArgNames({"MP", "edge"})->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_FullDecode)->Apply(large_jpegs);
+BENCHMARK(BM_ShrinkOnLoad)->Apply(large_jpegs);
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (VIPS_INIT(argv[0])) {
+        return 1;
+    }
+    // Identical calls would otherwise be answered from the operation cache
+    vips_cache_set_max(0);
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    vips_shutdown();
+    return 0;
+}
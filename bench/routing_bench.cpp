@@ -0,0 +1,99 @@
+// Per-request routing and query parsing: the table router and QueryParams
+// against the std::regex and unordered_map parsing they replaced, which is
+// kept here as the baseline. Counts heap allocations per request alongside
+// the time.
+//
+//   ./routing_bench --benchmark_out=routing.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include "router.hpp"
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+void* counted_alloc(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+// Every form that pairs with malloc/free, so nothing mixes with the
+// library's own allocator
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+const char* TARGETS[] = {
+    "/upload",
+    "/upload?format=webp&size=small",
+    "/upload?w=320&h=180&fit=cover&gravity=north&format=webp&q=75&effort=2",
+    "/upload/batch?sizes=64%2C128%2C256&formats=webp%2Cjpeg&q=80",
+};
+
+// What handle_request did before the router: copy the target, build a
+// regex, collect every match into a map, then compare path strings
+void BM_LegacyRouting(benchmark::State& state) {
+    const std::string target_text = TARGETS[state.range(0)];
+    beast::string_view target_view(target_text);
+    uint64_t before = allocations.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        bool multipart = target_view.starts_with("/upload");
+        std::unordered_map<std::string, std::string> params;
+        std::string target = target_view.to_string();
+        size_t qpos = target.find('?');
+        if (qpos != std::string::npos) {
+            std::string query = target.substr(qpos + 1);
+            std::regex param_regex("([a-zA-Z0-9_]+)=([^&]*)");
+            auto params_begin = std::sregex_iterator(query.begin(), query.end(), param_regex);
+            auto params_end = std::sregex_iterator();
+            for (auto it = params_begin; it != params_end; ++it) {
+                params[(*it)[1]] = (*it)[2];
+            }
+        }
+        bool batch = multipart && target_view.substr(0, target_view.find('?')) == "/upload/batch";
+        benchmark::DoNotOptimize(batch);
+        benchmark::DoNotOptimize(params.count("format"));
+    }
+    state.counters["allocs_per_request"] = benchmark::Counter(
+        static_cast<double>(allocations.load(std::memory_order_relaxed) - before) / state.iterations());
+    state.SetLabel(target_text);
+}
+
+void BM_Routing(benchmark::State& state) {
+    const std::string target_text = TARGETS[state.range(0)];
+    beast::string_view target_view(target_text);
+    uint64_t before = allocations.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        RequestTarget target = split_target(target_view);
+        Route route = find_route(http::verb::post, target.path);
+        QueryParams params;
+        auto error = params.parse(target.query);
+        benchmark::DoNotOptimize(route);
+        benchmark::DoNotOptimize(error);
+        benchmark::DoNotOptimize(params.get("format"));
+    }
+    state.counters["allocs_per_request"] = benchmark::Counter(
+        static_cast<double>(allocations.load(std::memory_order_relaxed) - before) / state.iterations());
+    state.SetLabel(target_text);
+}
+
+BENCHMARK(BM_LegacyRouting)->DenseRange(0, 3);
+BENCHMARK(BM_Routing)->DenseRange(0, 3);
+
+} // namespace
+
+BENCHMARK_MAIN();
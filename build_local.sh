@@ -39,6 +39,8 @@ if [[ "$OSTYPE" == "linux-gnu"* ]]; then
             libboost-all-dev \
             libvips-dev \
             libjpeg-turbo8-dev \
+            zlib1g-dev \
+            libbrotli-dev \
             pkg-config \
             curl
         
@@ -55,6 +57,8 @@ if [[ "$OSTYPE" == "linux-gnu"* ]]; then
             cmake3 \
             boost-devel \
             vips-devel \
+            zlib-devel \
+            brotli-devel \
             pkgconfig \
             curl
         
@@ -70,6 +74,7 @@ if [[ "$OSTYPE" == "linux-gnu"* ]]; then
         echo "- cmake"
         echo "- libboost-all-dev (or boost-devel)"
         echo "- libvips-dev (or vips-devel)"
+        echo "- zlib1g-dev and libbrotli-dev (or zlib-devel and brotli-devel)"
         echo "- pkg-config"
         echo ""
         exit 1
@@ -100,6 +105,7 @@ elif [[ "$OSTYPE" == "darwin"* ]]; then
         cmake \
         boost \
         vips \
+        brotli \
         pkg-config
     
 else
@@ -0,0 +1,101 @@
+#include "corpus.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string read_file(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot read " + path.string());
+    }
+    std::ostringstream data;
+    data << in.rdbuf();
+    return data.str();
+}
+
+std::string content_type_for(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+    if (ext == ".png") return "image/png";
+    if (ext == ".webp") return "image/webp";
+    if (ext == ".gif") return "image/gif";
+    if (ext == ".tif" || ext == ".tiff") return "image/tiff";
+    if (ext == ".avif") return "image/avif";
+    if (ext == ".heic" || ext == ".heif") return "image/heif";
+    if (ext == ".jxl") return "image/jxl";
+    return "application/octet-stream";
+}
+
+CorpusImage load_image(const fs::path& path) {
+    CorpusImage image;
+    image.name = path.filename().string();
+    image.content_type = content_type_for(path);
+    image.data = read_file(path);
+    return image;
+}
+
+} // namespace
+
+Corpus Corpus::from_directory(const std::string& dir) {
+    std::map<std::string, double> weights;
+    fs::path weights_file = fs::path(dir) / "weights.txt";
+    if (fs::exists(weights_file)) {
+        std::ifstream in(weights_file);
+        std::string name;
+        double weight;
+        while (in >> name >> weight) {
+            weights[name] = weight;
+        }
+    }
+
+    Corpus corpus;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::string name = entry.path().filename().string();
+        if (!entry.is_regular_file() || name == "weights.txt" || name[0] == '.') {
+            continue;
+        }
+        CorpusImage image = load_image(entry.path());
+        auto weight = weights.find(name);
+        if (weight != weights.end()) {
+            image.weight = weight->second;
+        }
+        if (image.weight > 0) {
+            corpus.images_.push_back(std::move(image));
+        }
+    }
+    if (corpus.images_.empty()) {
+        throw std::runtime_error("No images in " + dir);
+    }
+    // Directory order is unspecified; keep runs with the same seed repeatable
+    std::sort(corpus.images_.begin(), corpus.images_.end(),
+              [](const CorpusImage& a, const CorpusImage& b) { return a.name < b.name; });
+    corpus.build_distribution();
+    return corpus;
+}
+
+Corpus Corpus::from_file(const std::string& path) {
+    Corpus corpus;
+    corpus.images_.push_back(load_image(path));
+    corpus.build_distribution();
+    return corpus;
+}
+
+const CorpusImage& Corpus::sample(std::mt19937_64& rng) {
+    return images_[pick_(rng)];
+}
+
+void Corpus::build_distribution() {
+    std::vector<double> weights;
+    for (const auto& image : images_) weights.push_back(image.weight);
+    pick_ = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+struct CorpusImage {
+    std::string name;
+    std::string content_type;
+    std::string data;
+    double weight = 1.0;
+};
+
+// The images a load test uploads, drawn at random in proportion to their
+// weights so a run can mirror production's mix of sizes and formats
+class Corpus {
+public:
+    // Every regular file in dir. An optional weights.txt there holds
+    // "<file name> <weight>" lines; unlisted files weigh 1.
+    static Corpus from_directory(const std::string& dir);
+    static Corpus from_file(const std::string& path);
+
+    const CorpusImage& sample(std::mt19937_64& rng);
+
+    const std::vector<CorpusImage>& images() const { return images_; }
+
+private:
+    void build_distribution();
+
+    std::vector<CorpusImage> images_;
+    std::discrete_distribution<size_t> pick_;
+};
@@ -0,0 +1,91 @@
+#include "hdr_histogram.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+HdrHistogram::HdrHistogram() : counts_(BUCKETS, 0) {
+}
+
+size_t HdrHistogram::index_for(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    int octave = 63 - __builtin_clzll(value);
+    if (octave > MAX_OCTAVE) {
+        return BUCKETS - 1;
+    }
+    // The top SUB_BITS + 1 bits pick the bucket; the leading one is implied
+    uint64_t sub = (value >> (octave - SUB_BITS)) - SUB_BUCKETS;
+    return static_cast<size_t>(SUB_BUCKETS + (octave - SUB_BITS) * SUB_BUCKETS + sub);
+}
+
+uint64_t HdrHistogram::highest_equivalent(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    size_t offset = index - SUB_BUCKETS;
+    int shift = static_cast<int>(offset / SUB_BUCKETS);
+    uint64_t sub = offset % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void HdrHistogram::record(uint64_t value) {
+    counts_[index_for(value)]++;
+    total_++;
+    max_ = std::max(max_, value);
+    sum_ += static_cast<double>(value);
+}
+
+void HdrHistogram::merge(const HdrHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+uint64_t HdrHistogram::percentile(double percentile) const {
+    if (total_ == 0) {
+        return 0;
+    }
+    // Rank of the value at this percentile, 1-based and never below the first
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * total_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(highest_equivalent(i), max_);
+        }
+    }
+    return max_;
+}
+
+void HdrHistogram::write_hgrm(std::ostream& out) const {
+    char line[128];
+    std::snprintf(line, sizeof(line), "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount",
+                  "1/(1-Percentile)");
+    out << line;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        if (counts_[i] == 0) continue;
+        seen += counts_[i];
+        double fraction = static_cast<double>(seen) / static_cast<double>(total_);
+        double value_ms = static_cast<double>(std::min(highest_equivalent(i), max_)) / 1000.0;
+        if (seen < total_) {
+            std::snprintf(line, sizeof(line), "%12.3f %2.12f %10llu %14.2f\n", value_ms, fraction,
+                          static_cast<unsigned long long>(seen), 1.0 / (1.0 - fraction));
+        } else {
+            std::snprintf(line, sizeof(line), "%12.3f %2.12f %10llu\n", value_ms, fraction,
+                          static_cast<unsigned long long>(seen));
+        }
+        out << line;
+    }
+
+    std::snprintf(line, sizeof(line), "#[Mean    = %12.3f, Max        = %12.3f]\n",
+                  mean() / 1000.0, static_cast<double>(max_) / 1000.0);
+    out << line;
+    std::snprintf(line, sizeof(line), "#[Total count    = %12llu]\n", static_cast<unsigned long long>(total_));
+    out << line;
+}
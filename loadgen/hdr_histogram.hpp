@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// High dynamic range latency histogram in microseconds: exact below 128 us,
+// then 128 linear sub-buckets per power of two, so every recorded value is
+// within 1% up to about 19 hours. Not thread-safe.
+class HdrHistogram {
+public:
+    HdrHistogram();
+
+    void record(uint64_t value);
+    void merge(const HdrHistogram& other);
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? sum_ / static_cast<double>(total_) : 0.0; }
+
+    // Highest value equivalent to the one at this percentile (0-100)
+    uint64_t percentile(double percentile) const;
+
+    // HdrHistogram's percentile distribution (.hgrm) text, values in
+    // milliseconds, for the usual plotting tools
+    void write_hgrm(std::ostream& out) const;
+
+private:
+    static constexpr int SUB_BITS = 7;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BITS;
+    static constexpr int MAX_OCTAVE = 36;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (MAX_OCTAVE - SUB_BITS + 1) * SUB_BUCKETS;
+
+    static size_t index_for(uint64_t value);
+    static uint64_t highest_equivalent(size_t index);
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+    double sum_ = 0;
+};
@@ -0,0 +1,252 @@
+#include "load_generator.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <optional>
+
+// One client connection; carries one request at a time
+class LoadGenerator::Connection : public std::enable_shared_from_this<Connection> {
+public:
+    Connection(LoadGenerator& generator)
+        : generator_(generator), stream_(generator.ioc_) {
+    }
+
+    void send(Pending pending) {
+        pending_ = std::move(pending);
+        sent_at_ = std::chrono::steady_clock::now();
+        // The deadline runs from when the request should have gone out
+        stream_.expires_at(pending_.scheduled + generator_.config_.timeout);
+        if (connected_) {
+            return write();
+        }
+        stream_.async_connect(generator_.endpoints_,
+            beast::bind_front_handler(&Connection::on_connect, shared_from_this()));
+    }
+
+private:
+    void on_connect(beast::error_code ec, const tcp::endpoint&) {
+        if (ec) {
+            return fail();
+        }
+        stream_.socket().set_option(tcp::no_delay(true));
+        connected_ = true;
+        write();
+    }
+
+    void write() {
+        http::async_write(stream_, *pending_.request,
+            beast::bind_front_handler(&Connection::on_write, shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t) {
+        if (ec) {
+            return fail();
+        }
+        parser_.emplace();
+        parser_->body_limit(64 * 1024 * 1024);
+        http::async_read(stream_, buffer_, *parser_,
+            beast::bind_front_handler(&Connection::on_read, shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t) {
+        if (ec) {
+            return fail();
+        }
+        const auto& response = parser_->get();
+        bool reusable = generator_.config_.keep_alive && response.keep_alive();
+        if (!reusable) {
+            close();
+        }
+        generator_.on_complete(shared_from_this(), pending_, sent_at_, response.result_int(), reusable);
+    }
+
+    void fail() {
+        close();
+        generator_.on_complete(shared_from_this(), pending_, sent_at_, 0, false);
+    }
+
+    void close() {
+        beast::error_code ec;
+        stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+        stream_.close();
+        connected_ = false;
+    }
+
+    LoadGenerator& generator_;
+    beast::tcp_stream stream_;
+    beast::flat_buffer buffer_;
+    std::optional<http::response_parser<http::string_body>> parser_;
+    bool connected_ = false;
+    Pending pending_;
+    std::chrono::steady_clock::time_point sent_at_;
+};
+
+namespace {
+
+uint64_t microseconds_between(std::chrono::steady_clock::time_point from,
+                              std::chrono::steady_clock::time_point to) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+    return elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0;
+}
+
+std::string random_hex(std::mt19937_64& rng) {
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(rng()));
+    return hex;
+}
+
+} // namespace
+
+LoadGenerator::LoadGenerator(const LoadConfig& config, Corpus corpus)
+    : config_(config),
+      corpus_(std::move(corpus)),
+      rng_(config.seed),
+      tick_timer_(ioc_) {
+    tcp::resolver resolver(ioc_);
+    endpoints_ = resolver.resolve(config_.host, config_.port);
+}
+
+LoadResult LoadGenerator::run() {
+    start_ = std::chrono::steady_clock::now();
+    measure_from_ = start_ + config_.warmup;
+    end_ = measure_from_ + config_.duration;
+    last_response_ = start_;
+    net::post(ioc_, [this] { on_tick(); });
+    ioc_.run();
+
+    result_.elapsed_seconds = std::chrono::duration<double>(last_response_ - measure_from_).count();
+    return result_;
+}
+
+void LoadGenerator::on_tick() {
+    // Send everything whose scheduled time has passed, even if the timer
+    // fired late, so a stall on this side can't thin out the arrivals
+    auto now = std::chrono::steady_clock::now();
+    while (true) {
+        auto scheduled = start_ + std::chrono::nanoseconds(
+            static_cast<int64_t>(static_cast<double>(scheduled_) * 1e9 / config_.rate));
+        if (scheduled >= end_) {
+            sending_done_ = true;
+            break;
+        }
+        if (scheduled > now) {
+            tick_timer_.expires_at(scheduled);
+            tick_timer_.async_wait([this](beast::error_code ec) {
+                if (!ec) on_tick();
+            });
+            return;
+        }
+        ++scheduled_;
+        if (scheduled >= measure_from_) {
+            ++result_.sent;
+        }
+        dispatch({scheduled, make_request()});
+    }
+    // Every request times out by end_ + timeout, so this always drains
+    maybe_finish();
+}
+
+std::shared_ptr<LoadGenerator::Request> LoadGenerator::make_request() {
+    const CorpusImage& image = corpus_.sample(rng_);
+
+    std::string target = config_.raw ? "/thumbnail" : "/upload";
+    char separator = '?';
+    if (!config_.sizes.empty()) {
+        int size = config_.sizes[rng_() % config_.sizes.size()];
+        target += separator + std::string("w=") + std::to_string(size) + "&h=" + std::to_string(size);
+        separator = '&';
+    }
+    if (!config_.formats.empty()) {
+        target += separator + std::string("format=") + config_.formats[rng_() % config_.formats.size()];
+    }
+
+    auto request = std::make_shared<Request>(config_.raw ? http::verb::put : http::verb::post, target, 11);
+    request->set(http::field::host, config_.host);
+    request->set(http::field::user_agent, "thumbnail_loadgen");
+    request->keep_alive(config_.keep_alive);
+
+    // Trailing bytes after the image data are ignored by the decoders
+    std::string salt = config_.unique ? random_hex(rng_) : std::string();
+    if (config_.raw) {
+        request->set(http::field::content_type, image.content_type);
+        request->body().reserve(image.data.size() + salt.size());
+        request->body() = image.data;
+        request->body() += salt;
+    } else {
+        // A fresh boundary per request, as browsers do
+        std::string boundary = "----thumbnailgen" + random_hex(rng_);
+        std::string& body = request->body();
+        body.reserve(image.data.size() + salt.size() + 256);
+        body += "--" + boundary + "\r\n";
+        body += "Content-Disposition: form-data; name=\"file\"; filename=\"" + image.name + "\"\r\n";
+        body += "Content-Type: " + image.content_type + "\r\n\r\n";
+        body += image.data;
+        body += salt;
+        body += "\r\n--" + boundary + "--\r\n";
+        request->set(http::field::content_type, "multipart/form-data; boundary=" + boundary);
+    }
+    request->prepare_payload();
+    return request;
+}
+
+void LoadGenerator::dispatch(Pending pending) {
+    if (std::chrono::steady_clock::now() >= pending.scheduled + config_.timeout) {
+        // Waited out its whole timeout for a connection and was never sent
+        return record(pending, std::nullopt, 0);
+    }
+    if (!idle_.empty()) {
+        ++in_flight_;
+        auto connection = std::move(idle_.back());
+        idle_.pop_back();
+        connection->send(std::move(pending));
+    } else if (open_ < config_.connections) {
+        ++in_flight_;
+        ++open_;
+        std::make_shared<Connection>(*this)->send(std::move(pending));
+    } else {
+        waiting_.push_back(std::move(pending));
+    }
+}
+
+void LoadGenerator::on_complete(const std::shared_ptr<Connection>& connection, const Pending& pending,
+                                std::chrono::steady_clock::time_point sent_at, unsigned status,
+                                bool reusable) {
+    --in_flight_;
+    record(pending, sent_at, status);
+
+    if (reusable) {
+        idle_.push_back(connection);
+    } else {
+        --open_;
+    }
+    while (!waiting_.empty() && (!idle_.empty() || open_ < config_.connections)) {
+        Pending next = std::move(waiting_.front());
+        waiting_.pop_front();
+        dispatch(std::move(next));
+    }
+    maybe_finish();
+}
+
+void LoadGenerator::record(const Pending& pending, std::optional<std::chrono::steady_clock::time_point> sent_at,
+                           unsigned status) {
+    if (pending.scheduled < measure_from_) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    last_response_ = now;
+    if (status == 0) {
+        result_.failed++;
+    } else {
+        result_.completed++;
+        result_.status_counts[status]++;
+    }
+    result_.latency.record(microseconds_between(pending.scheduled, now));
+    if (sent_at) {
+        result_.service_time.record(microseconds_between(*sent_at, now));
+    }
+}
+
+void LoadGenerator::maybe_finish() {
+    if (sending_done_ && in_flight_ == 0 && waiting_.empty()) {
+        ioc_.stop();
+    }
+}
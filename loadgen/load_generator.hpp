@@ -0,0 +1,113 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include "corpus.hpp"
+#include "hdr_histogram.hpp"
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+struct LoadConfig {
+    std::string host = "localhost";
+    std::string port = "8080";
+    // POST multipart to /upload, or PUT the raw image to /thumbnail
+    bool raw = false;
+
+    // Open-loop arrival rate and how long to keep it up; requests sent in
+    // the warmup are not reported
+    double rate = 100;
+    std::chrono::seconds duration{30};
+    std::chrono::seconds warmup{0};
+    // Most connections open at once; arrivals beyond that wait their turn,
+    // and the wait counts towards their latency
+    size_t connections = 64;
+    bool keep_alive = true;
+    // Give up on a request (and count it as failed) this long after it was
+    // due to be sent
+    std::chrono::seconds timeout{30};
+
+    // Each request picks one edge and one format at random; empty leaves
+    // the parameter to the server's default
+    std::vector<int> sizes;
+    std::vector<std::string> formats;
+    // Append random bytes to every upload so the server's result cache and
+    // request coalescing never see the same image twice
+    bool unique = false;
+    uint64_t seed = 1;
+};
+
+struct LoadResult {
+    uint64_t sent = 0;
+    uint64_t completed = 0;          // got a response
+    uint64_t failed = 0;             // connect/write/read error or timeout
+    std::map<unsigned, uint64_t> status_counts;
+    double elapsed_seconds = 0;      // from the first send to the last response
+    // From each request's scheduled send time, so time spent waiting for a
+    // connection is counted (no coordinated omission)
+    HdrHistogram latency;
+    // From the moment the request was actually written
+    HdrHistogram service_time;
+};
+
+// Sends requests at a constant rate regardless of how fast the server
+// answers, on a single I/O thread
+class LoadGenerator {
+public:
+    LoadGenerator(const LoadConfig& config, Corpus corpus);
+
+    LoadResult run();
+
+private:
+    class Connection;
+    using Request = http::request<http::string_body>;
+
+    struct Pending {
+        std::chrono::steady_clock::time_point scheduled;
+        std::shared_ptr<Request> request;
+    };
+
+    void on_tick();
+    std::shared_ptr<Request> make_request();
+    void dispatch(Pending pending);
+    // Called by a connection when its request finished; status is 0 on failure
+    void on_complete(const std::shared_ptr<Connection>& connection, const Pending& pending,
+                     std::chrono::steady_clock::time_point sent_at, unsigned status, bool reusable);
+    // Count a finished request; sent_at is empty if it was never sent
+    void record(const Pending& pending, std::optional<std::chrono::steady_clock::time_point> sent_at,
+                unsigned status);
+    void maybe_finish();
+
+    LoadConfig config_;
+    Corpus corpus_;
+    std::mt19937_64 rng_;
+
+    net::io_context ioc_;
+    tcp::resolver::results_type endpoints_;
+    net::steady_timer tick_timer_;
+
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point measure_from_;
+    std::chrono::steady_clock::time_point end_;
+    std::chrono::steady_clock::time_point last_response_;
+    uint64_t scheduled_ = 0;
+    bool sending_done_ = false;
+
+    std::deque<Pending> waiting_;
+    std::vector<std::shared_ptr<Connection>> idle_;
+    size_t open_ = 0;
+    size_t in_flight_ = 0;
+
+    LoadResult result_;
+};
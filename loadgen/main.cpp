@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "load_generator.hpp"
+
+namespace {
+
+std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+double ms(uint64_t microseconds) {
+    return static_cast<double>(microseconds) / 1000.0;
+}
+
+void print_latency(const char* title, const HdrHistogram& histogram) {
+    std::printf("%s\n", title);
+    std::printf("  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  p99.99 %.2f  max %.2f  (mean %.2f)\n",
+                ms(histogram.percentile(50)), ms(histogram.percentile(90)), ms(histogram.percentile(99)),
+                ms(histogram.percentile(99.9)), ms(histogram.percentile(99.99)), ms(histogram.max()),
+                histogram.mean() / 1000.0);
+}
+
+// One flat object, one key per line, so shell scripts can grep it
+void write_json(const std::string& path, const LoadConfig& config, const LoadResult& result, double goal_ms) {
+    std::ofstream out(path);
+    const HdrHistogram& latency = result.latency;
+    uint64_t ok = result.status_counts.count(200) ? result.status_counts.at(200) : 0;
+    out << "{\n";
+    out << "  \"target_rate\": " << config.rate << ",\n";
+    out << "  \"duration_seconds\": " << config.duration.count() << ",\n";
+    out << "  \"connections\": " << config.connections << ",\n";
+    out << "  \"keep_alive\": " << (config.keep_alive ? "true" : "false") << ",\n";
+    out << "  \"sent\": " << result.sent << ",\n";
+    out << "  \"completed\": " << result.completed << ",\n";
+    out << "  \"ok\": " << ok << ",\n";
+    out << "  \"failed\": " << result.failed << ",\n";
+    out << "  \"achieved_rate\": " << (result.elapsed_seconds > 0 ? result.completed / result.elapsed_seconds : 0) << ",\n";
+    out << "  \"p50_ms\": " << ms(latency.percentile(50)) << ",\n";
+    out << "  \"p90_ms\": " << ms(latency.percentile(90)) << ",\n";
+    out << "  \"p99_ms\": " << ms(latency.percentile(99)) << ",\n";
+    out << "  \"p999_ms\": " << ms(latency.percentile(99.9)) << ",\n";
+    out << "  \"p9999_ms\": " << ms(latency.percentile(99.99)) << ",\n";
+    out << "  \"max_ms\": " << ms(latency.max()) << ",\n";
+    out << "  \"service_p99_ms\": " << ms(result.service_time.percentile(99)) << ",\n";
+    out << "  \"goal_ms\": " << goal_ms << ",\n";
+    out << "  \"goal_met\": " << (ms(latency.percentile(99)) < goal_ms && result.failed == 0 ? "true" : "false") << "\n";
+    out << "}\n";
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [OPTIONS]\n"
+              << "Open-loop load generator for the thumbnail service. Requests are sent at a\n"
+              << "fixed rate whether or not earlier ones have been answered, and latency is\n"
+              << "measured from when each request was due, so a slow server can't hide its\n"
+              << "queueing delay (no coordinated omission).\n\n"
+              << "Options:\n"
+              << "  --host HOST         Server host (default: localhost)\n"
+              << "  --port PORT         Server port (default: 8080)\n"
+              << "  --raw               PUT raw images to /thumbnail instead of multipart to /upload\n"
+              << "  --rate N            Requests per second (default: 100)\n"
+              << "  --duration SEC      Measured run length (default: 30)\n"
+              << "  --warmup SEC        Unmeasured lead-in at the same rate (default: 0)\n"
+              << "  --connections N     Most connections open at once (default: 64)\n"
+              << "  --no-keepalive      Open a new connection for every request\n"
+              << "  --timeout SEC       Fail requests not answered this long after they were due (default: 30)\n"
+              << "  --corpus DIR        Upload images from DIR; weights.txt there may hold\n"
+              << "                      \"<file> <weight>\" lines (default weight 1)\n"
+              << "  --image FILE        Upload a single image (default: test_image.jpg)\n"
+              << "  --sizes LIST        Comma-separated edges; each request picks one (default: server's)\n"
+              << "  --formats LIST      Comma-separated output formats; each request picks one\n"
+              << "  --unique            Make every upload distinct so no result is served from cache\n"
+              << "  --seed N            Random seed for image, size and format choices (default: 1)\n"
+              << "  --goal-ms MS        p99 latency goal to report against (default: 50)\n"
+              << "  --json FILE         Write a summary as JSON\n"
+              << "  --hgrm FILE         Write the latency percentile distribution in HdrHistogram format\n"
+              << "  --help              Show this help message\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        LoadConfig config;
+        std::string corpus_dir;
+        std::string image = "test_image.jpg";
+        std::string json_path;
+        std::string hgrm_path;
+        double goal_ms = 50;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--host" && i + 1 < argc) {
+                config.host = argv[++i];
+            } else if (arg == "--port" && i + 1 < argc) {
+                config.port = argv[++i];
+            } else if (arg == "--raw") {
+                config.raw = true;
+            } else if (arg == "--rate" && i + 1 < argc) {
+                config.rate = std::stod(argv[++i]);
+            } else if (arg == "--duration" && i + 1 < argc) {
+                config.duration = std::chrono::seconds(std::stoi(argv[++i]));
+            } else if (arg == "--warmup" && i + 1 < argc) {
+                config.warmup = std::chrono::seconds(std::stoi(argv[++i]));
+            } else if (arg == "--connections" && i + 1 < argc) {
+                config.connections = std::stoul(argv[++i]);
+            } else if (arg == "--no-keepalive") {
+                config.keep_alive = false;
+            } else if (arg == "--timeout" && i + 1 < argc) {
+                config.timeout = std::chrono::seconds(std::stoi(argv[++i]));
+            } else if (arg == "--corpus" && i + 1 < argc) {
+                corpus_dir = argv[++i];
+            } else if (arg == "--image" && i + 1 < argc) {
+                image = argv[++i];
+            } else if (arg == "--sizes" && i + 1 < argc) {
+                for (const auto& size : split_list(argv[++i])) config.sizes.push_back(std::stoi(size));
+            } else if (arg == "--formats" && i + 1 < argc) {
+                config.formats = split_list(argv[++i]);
+            } else if (arg == "--unique") {
+                config.unique = true;
+            } else if (arg == "--seed" && i + 1 < argc) {
+                config.seed = std::stoull(argv[++i]);
+            } else if (arg == "--goal-ms" && i + 1 < argc) {
+                goal_ms = std::stod(argv[++i]);
+            } else if (arg == "--json" && i + 1 < argc) {
+                json_path = argv[++i];
+            } else if (arg == "--hgrm" && i + 1 < argc) {
+                hgrm_path = argv[++i];
+            } else if (arg == "--help") {
+                print_usage(argv[0]);
+                return 0;
+            } else {
+                std::cerr << "Unknown option: " << arg << " (see --help)" << std::endl;
+                return 1;
+            }
+        }
+        if (config.rate <= 0 || config.connections == 0) {
+            std::cerr << "--rate and --connections must be positive" << std::endl;
+            return 1;
+        }
+
+        Corpus corpus = corpus_dir.empty() ? Corpus::from_file(image) : Corpus::from_directory(corpus_dir);
+        std::printf("Target: %.1f req/s for %llds (+%llds warmup), up to %zu connections, %s, %zu image(s)\n",
+                    config.rate, static_cast<long long>(config.duration.count()),
+                    static_cast<long long>(config.warmup.count()), config.connections,
+                    config.keep_alive ? "keep-alive" : "new connection per request", corpus.images().size());
+        std::fflush(stdout);
+
+        LoadGenerator generator(config, std::move(corpus));
+        LoadResult result = generator.run();
+
+        std::printf("Sent %llu, completed %llu, failed %llu; %.1f req/s achieved\n",
+                    static_cast<unsigned long long>(result.sent),
+                    static_cast<unsigned long long>(result.completed),
+                    static_cast<unsigned long long>(result.failed),
+                    result.elapsed_seconds > 0 ? result.completed / result.elapsed_seconds : 0.0);
+        std::printf("Responses:");
+        for (const auto& [status, count] : result.status_counts) {
+            std::printf(" %u=%llu", status, static_cast<unsigned long long>(count));
+        }
+        std::printf("\n");
+        print_latency("Latency from scheduled send (ms):", result.latency);
+        print_latency("Service time from actual send (ms):", result.service_time);
+
+        double p99 = ms(result.latency.percentile(99));
+        bool met = p99 < goal_ms && result.failed == 0;
+        std::printf("p99 goal (%.0f ms): %s\n", goal_ms, met ? "MET" : "MISSED");
+
+        if (!json_path.empty()) {
+            write_json(json_path, config, result, goal_ms);
+        }
+        if (!hgrm_path.empty()) {
+            std::ofstream out(hgrm_path);
+            result.latency.write_hgrm(out);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -8,9 +8,16 @@ set -e
 # Configuration
 SERVICE_URL="http://localhost:8080"
 TEST_IMAGE="test_image.jpg"
+CORPUS=""
 DURATION=30
-THREADS=4
-CONNECTIONS=50
+WARMUP=5
+RATE=200
+CONNECTIONS=64
+SIZES=""
+FORMATS=""
+LOADGEN_FLAGS=""
+GOAL_MS=50
+LOADGEN="${LOADGEN:-./build/thumbnail_loadgen}"
 
 # Colors for output
 RED='\033[0;31m'
@@ -44,8 +51,9 @@ check_dependencies() {
         exit 1
     fi
     
-    if ! command -v wrk &> /dev/null; then
-        log_error "wrk is required but not installed. Install with: sudo apt-get install wrk"
+    if [ ! -x "$LOADGEN" ]; then
+        log_error "Load generator not found at $LOADGEN"
+        log_info "Build it with: cmake -S . -B build && cmake --build build --target thumbnail_loadgen"
         exit 1
     fi
     
@@ -104,22 +112,39 @@ run_single_request_test() {
 }
 
 run_load_test() {
-    log_info "Running load test with wrk..."
-    log_info "Parameters: $THREADS threads, $CONNECTIONS connections, ${DURATION}s duration"
+    log_info "Running open-loop load test..."
+    log_info "Parameters: ${RATE} req/s for ${DURATION}s after ${WARMUP}s warmup, up to $CONNECTIONS connections"
     
-    # Run wrk load test
-    wrk -t$THREADS -c$CONNECTIONS -d${DURATION}s -s scripts/post.lua "$SERVICE_URL/upload" > /tmp/wrk_output.txt 2>&1
+    # Latency is measured from each request's scheduled send time, so queueing
+    # behind a slow server shows up in the percentiles instead of lowering the rate
+    local hostport="${SERVICE_URL#*://}"
+    local args=(--host "${hostport%%:*}" --port "${hostport##*:}"
+                --rate "$RATE" --duration "$DURATION" --warmup "$WARMUP"
+                --connections "$CONNECTIONS" --goal-ms "$GOAL_MS"
+                --json /tmp/loadgen.json --hgrm "$HGRM_FILE")
+    if [ -n "$CORPUS" ]; then
+        args+=(--corpus "$CORPUS")
+    else
+        args+=(--image "$TEST_IMAGE")
+    fi
+    [ -n "$SIZES" ] && args+=(--sizes "$SIZES")
+    [ -n "$FORMATS" ] && args+=(--formats "$FORMATS")
     
-    if [ $? -eq 0 ]; then
+    if "$LOADGEN" "${args[@]}" $LOADGEN_FLAGS > /tmp/loadgen_output.txt 2>&1; then
         log_success "Load test completed"
-        cat /tmp/wrk_output.txt
+        cat /tmp/loadgen_output.txt
     else
         log_error "Load test failed"
-        cat /tmp/wrk_output.txt
+        cat /tmp/loadgen_output.txt
         exit 1
     fi
 }
 
+# Reads one numeric field from the load generator's JSON summary
+loadgen_value() {
+    grep "\"$1\":" /tmp/loadgen.json | sed 's/.*: *//; s/,$//'
+}
+
 get_metrics() {
     log_info "Fetching current metrics..."
     
@@ -138,19 +163,26 @@ get_metrics() {
 generate_report() {
     log_info "Generating benchmark report..."
     
-    local report_file="benchmark_report_$(date +%Y%m%d_%H%M%S).txt"
+    local report_file="$REPORT_FILE"
     
     {
         echo "ThumbnailGen Benchmark Report"
         echo "============================"
         echo "Date: $(date)"
         echo "Service URL: $SERVICE_URL"
-        echo "Test Image: $TEST_IMAGE ($(stat -c%s "$TEST_IMAGE") bytes)"
+        if [ -n "$CORPUS" ]; then
+            echo "Corpus: $CORPUS"
+        else
+            echo "Test Image: $TEST_IMAGE ($(stat -c%s "$TEST_IMAGE") bytes)"
+        fi
         echo ""
         echo "Configuration:"
-        echo "  Threads: $THREADS"
-        echo "  Connections: $CONNECTIONS"
-        echo "  Duration: ${DURATION}s"
+        echo "  Rate: ${RATE} req/s (open loop)"
+        echo "  Connections: up to $CONNECTIONS"
+        echo "  Duration: ${DURATION}s after ${WARMUP}s warmup"
+        echo "  Sizes: ${SIZES:-server default}"
+        echo "  Formats: ${FORMATS:-negotiated}"
+        [ -n "$LOADGEN_FLAGS" ] && echo "  Load generator flags: $LOADGEN_FLAGS"
         echo ""
         echo "Single Request Test:"
         if [ -f /tmp/single_request_time.txt ]; then
@@ -158,8 +190,9 @@ generate_report() {
         fi
         echo ""
         echo "Load Test Results:"
-        if [ -f /tmp/wrk_output.txt ]; then
-            cat /tmp/wrk_output.txt
+        if [ -f /tmp/loadgen_output.txt ]; then
+            cat /tmp/loadgen_output.txt
+            echo "  Latency distribution: $HGRM_FILE"
         fi
         echo ""
         echo "Current Metrics:"
@@ -168,12 +201,19 @@ generate_report() {
         fi
         echo ""
         echo "Performance Analysis:"
-        if [ -f /tmp/current_metrics.txt ]; then
-            local p99_latency=$(grep "P99 latency" /tmp/current_metrics.txt | awk '{print $3}' | sed 's/ms//')
-            if (( $(echo "$p99_latency < 50" | bc -l) )); then
-                echo "  ✅ P99 latency ($p99_latency ms) meets <50ms goal"
+        if [ -f /tmp/loadgen.json ]; then
+            local p99_latency=$(loadgen_value p99_ms)
+            local p999_latency=$(loadgen_value p999_ms)
+            local sent=$(loadgen_value sent)
+            local ok=$(loadgen_value ok)
+            if awk -v p99="$p99_latency" -v goal="$GOAL_MS" 'BEGIN { exit !(p99 < goal) }'; then
+                echo "  ✅ P99 latency ($p99_latency ms) meets <${GOAL_MS}ms goal"
             else
-                echo "  ❌ P99 latency ($p99_latency ms) exceeds <50ms goal"
+                echo "  ❌ P99 latency ($p99_latency ms) exceeds <${GOAL_MS}ms goal"
+            fi
+            echo "  P99.9 latency: $p999_latency ms"
+            if [ "$ok" != "$sent" ]; then
+                echo "  ⚠️  Only $ok of $sent requests returned 200"
             fi
         fi
     } > "$report_file"
@@ -185,7 +225,7 @@ generate_report() {
 
 cleanup() {
     log_info "Cleaning up temporary files..."
-    rm -f /tmp/thumbnail.png /tmp/single_request_time.txt /tmp/wrk_output.txt /tmp/current_metrics.txt
+    rm -f /tmp/thumbnail.png /tmp/single_request_time.txt /tmp/loadgen_output.txt /tmp/loadgen.json /tmp/current_metrics.txt
 }
 
 # Main execution
@@ -196,7 +236,14 @@ main() {
     
     check_dependencies
     check_service
-    create_test_image
+    if [ -z "$CORPUS" ]; then
+        create_test_image
+    else
+        TEST_IMAGE=$(find "$CORPUS" -maxdepth 1 -type f ! -name weights.txt ! -name '.*' | sort | head -1)
+    fi
+    
+    REPORT_FILE="benchmark_report_$(date +%Y%m%d_%H%M%S).txt"
+    HGRM_FILE="${REPORT_FILE%.txt}.hgrm"
     
     # Run tests
     run_single_request_test
@@ -227,22 +274,51 @@ while [[ $# -gt 0 ]]; do
             DURATION="$2"
             shift 2
             ;;
-        --threads)
-            THREADS="$2"
+        --corpus)
+            CORPUS="$2"
+            shift 2
+            ;;
+        --rate)
+            RATE="$2"
+            shift 2
+            ;;
+        --warmup)
+            WARMUP="$2"
             shift 2
             ;;
         --connections)
             CONNECTIONS="$2"
             shift 2
             ;;
+        --sizes)
+            SIZES="$2"
+            shift 2
+            ;;
+        --formats)
+            FORMATS="$2"
+            shift 2
+            ;;
+        --no-keepalive|--unique|--raw)
+            LOADGEN_FLAGS="$LOADGEN_FLAGS $1"
+            shift
+            ;;
         --help)
             echo "Usage: $0 [OPTIONS]"
             echo "Options:"
             echo "  --url URL         Service URL (default: http://localhost:8080)"
             echo "  --image FILE      Test image file (default: test_image.jpg)"
-            echo "  --duration SEC    Test duration in seconds (default: 30)"
-            echo "  --threads N       Number of wrk threads (default: 4)"
-            echo "  --connections N   Number of connections (default: 50)"
+            echo "  --corpus DIR      Upload images from DIR, weighted by DIR/weights.txt"
+            echo "  --rate N          Requests per second, sent open loop (default: 200)"
+            echo "  --duration SEC    Measured test duration in seconds (default: 30)"
+            echo "  --warmup SEC      Unmeasured warmup at the same rate (default: 5)"
+            echo "  --connections N   Most connections open at once (default: 64)"
+            echo "  --sizes LIST      Comma-separated thumbnail edges to pick from per request"
+            echo "  --formats LIST    Comma-separated output formats to pick from per request"
+            echo "  --no-keepalive    Open a new connection for every request"
+            echo "  --unique          Make every upload distinct to bypass the result cache"
+            echo "  --raw             PUT raw images to /thumbnail instead of multipart uploads"
+            echo ""
+            echo "Set LOADGEN to the thumbnail_loadgen binary (default: ./build/thumbnail_loadgen)"
             echo "  --help            Show this help message"
             exit 0
             ;;
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Build and run the Google Benchmark suite, writing one JSON file per
+# benchmark binary under bench-results/<commit>/ so runs can be compared
+# across commits. Extra arguments are passed to every binary, e.g.
+#   scripts/microbenchmarks.sh --benchmark_filter='in:jpeg' --benchmark_repetitions=5
+
+set -e
+
+BUILD_DIR="${BUILD_DIR:-build-bench}"
+RESULTS_ROOT="${RESULTS_ROOT:-bench-results}"
+BENCHMARKS="pipeline_bench multipart_bench metrics_bench processor_bench routing_bench"
+
+# Colors for output
+BLUE='\033[0;34m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+log_info() {
+    echo -e "${BLUE}[INFO]${NC} $1"
+}
+
+log_success() {
+    echo -e "${GREEN}[SUCCESS]${NC} $1"
+}
+
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if [ -n "$(git status --porcelain --untracked-files=no 2>/dev/null)" ]; then
+    COMMIT="${COMMIT}-dirty"
+fi
+RESULTS_DIR="$RESULTS_ROOT/$COMMIT"
+
+log_info "Building benchmarks in $BUILD_DIR..."
+cmake -S . -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DTHUMBNAILGEN_BUILD_BENCHMARKS=ON > /dev/null
+cmake --build "$BUILD_DIR" -j"$(nproc)" --target $BENCHMARKS
+
+mkdir -p "$RESULTS_DIR"
+for bench in $BENCHMARKS; do
+    log_info "Running $bench..."
+    "$BUILD_DIR/bench/$bench" \
+        --benchmark_out="$RESULTS_DIR/$bench.json" \
+        --benchmark_out_format=json \
+        --benchmark_context=commit="$COMMIT" \
+        "$@"
+done
+
+log_success "Results written to $RESULTS_DIR"
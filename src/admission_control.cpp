@@ -0,0 +1,38 @@
+#include "admission_control.hpp"
+
+AdmissionControl::Ticket& AdmissionControl::Ticket::operator=(Ticket&& other) noexcept {
+    if (this != &other) {
+        release();
+        owner_ = other.owner_;
+        bytes_ = other.bytes_;
+        other.owner_ = nullptr;
+    }
+    return *this;
+}
+
+void AdmissionControl::Ticket::release() {
+    if (owner_) {
+        owner_->in_flight_.fetch_sub(1, std::memory_order_relaxed);
+        owner_->in_flight_bytes_.fetch_sub(bytes_, std::memory_order_relaxed);
+        owner_ = nullptr;
+    }
+}
+
+AdmissionControl::AdmissionControl(size_t max_requests, uint64_t max_bytes)
+    : max_requests_(max_requests), max_bytes_(max_bytes) {
+}
+
+std::optional<AdmissionControl::Ticket> AdmissionControl::try_acquire(uint64_t bytes) {
+    // Optimistically reserve, then back out if that overshot a limit
+    size_t requests = in_flight_.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t total_bytes = in_flight_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+    // A lone request is always let through so an oversized budget can't wedge the server
+    bool over = requests > max_requests_ || (total_bytes > max_bytes_ && requests > 1);
+    if (over) {
+        in_flight_.fetch_sub(1, std::memory_order_relaxed);
+        in_flight_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    return Ticket(this, bytes);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Caps how many uploads (and how many body bytes) the server takes on at
+// once. Requests are admitted from their headers alone, so an overloaded
+// server can refuse work before buffering a 20 MB body for it.
+class AdmissionControl {
+public:
+    // Releases its reservation when destroyed
+    class Ticket {
+    public:
+        Ticket(AdmissionControl* owner, uint64_t bytes) : owner_(owner), bytes_(bytes) {}
+        Ticket(Ticket&& other) noexcept : owner_(other.owner_), bytes_(other.bytes_) { other.owner_ = nullptr; }
+        Ticket& operator=(Ticket&& other) noexcept;
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket() { release(); }
+
+    private:
+        void release();
+
+        AdmissionControl* owner_;
+        uint64_t bytes_;
+    };
+
+    AdmissionControl(size_t max_requests, uint64_t max_bytes);
+
+    // Reserve room for one upload of the given size, or nothing if full
+    std::optional<Ticket> try_acquire(uint64_t bytes);
+
+    size_t in_flight() const { return in_flight_.load(std::memory_order_relaxed); }
+    uint64_t in_flight_bytes() const { return in_flight_bytes_.load(std::memory_order_relaxed); }
+    size_t max_requests() const { return max_requests_; }
+
+private:
+    size_t max_requests_;
+    uint64_t max_bytes_;
+    std::atomic<size_t> in_flight_{0};
+    std::atomic<uint64_t> in_flight_bytes_{0};
+};
@@ -0,0 +1,332 @@
+#include "disk_cache.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <unistd.h>
+#include "hash.hpp"
+#include "logger.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint64_t INDEX_MAGIC = 0x3158444943444754ULL; // "TGDCIDX1"
+constexpr uint32_t RECORD_MAGIC = 0x52434754;           // "TGCR"
+constexpr size_t INDEX_HEADER_BYTES = 64;
+constexpr const char* INDEX_FILE = "index";
+constexpr const char* SEGMENT_SUFFIX = ".seg";
+
+struct IndexHeader {
+    uint64_t magic;
+    uint64_t slot_count;
+    uint32_t next_segment; // never reused, so a stale slot can't name a newer segment
+};
+
+// Precedes the key parameters and the thumbnail in a segment
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t params_size;
+    uint64_t content_hash;
+    uint64_t content_size;
+    uint64_t value_size;
+    uint64_t value_hash;
+};
+
+[[noreturn]] void throw_errno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+size_t round_up_pow2(size_t value) {
+    size_t pow2 = 1;
+    while (pow2 < value) pow2 <<= 1;
+    return pow2;
+}
+
+// "00000042.seg" -> 42; 0 for anything else
+uint32_t segment_id(const fs::path& path) {
+    if (path.extension() != SEGMENT_SUFFIX) return 0;
+    std::string stem = path.stem().string();
+    if (stem.empty() || stem.find_first_not_of("0123456789") != std::string::npos) return 0;
+    return static_cast<uint32_t>(std::strtoul(stem.c_str(), nullptr, 10));
+}
+
+} // namespace
+
+// 0 in segment marks a slot that was never used; segment ids start at 1
+struct DiskCache::Slot {
+    uint64_t digest;
+    uint64_t offset;
+    uint32_t segment;
+    uint32_t value_size;
+};
+
+DiskCache::Segment::~Segment() {
+    if (fd >= 0) ::close(fd);
+}
+
+DiskCache::DiskCache(const std::string& dir, uint64_t max_bytes)
+    : dir_(dir),
+      max_bytes_(max_bytes),
+      segment_bytes_(std::clamp<uint64_t>(max_bytes / 16, 1 << 20, 64 << 20)) {
+    try {
+        open();
+    } catch (...) {
+        // The destructor doesn't run for a cache that failed to open
+        close();
+        throw;
+    }
+}
+
+DiskCache::~DiskCache() {
+    close();
+}
+
+void DiskCache::open() {
+    fs::create_directories(dir_);
+
+    // Sized for 4 KiB thumbnails on average; being a cache, a full probe
+    // sequence just overwrites its oldest candidate
+    slot_count_ = round_up_pow2(std::max<uint64_t>(max_bytes_ / 4096, 1024));
+    index_bytes_ = INDEX_HEADER_BYTES + slot_count_ * sizeof(Slot);
+
+    std::string index_path = (fs::path(dir_) / INDEX_FILE).string();
+    index_fd_ = ::open(index_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (index_fd_ < 0) {
+        throw_errno("open " + index_path);
+    }
+    struct stat st;
+    IndexHeader existing{};
+    if (::fstat(index_fd_, &st) != 0) {
+        throw_errno("stat " + index_path);
+    }
+    bool usable = static_cast<size_t>(st.st_size) == index_bytes_ &&
+                  ::pread(index_fd_, &existing, sizeof(existing), 0) == sizeof(existing) &&
+                  existing.magic == INDEX_MAGIC && existing.slot_count == slot_count_;
+    // Truncating to nothing and back zeroes every slot without writing them
+    if (!usable && (::ftruncate(index_fd_, 0) != 0 ||
+                    ::ftruncate(index_fd_, static_cast<off_t>(index_bytes_)) != 0)) {
+        throw_errno("resize " + index_path);
+    }
+    index_ = ::mmap(nullptr, index_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, index_fd_, 0);
+    if (index_ == MAP_FAILED) {
+        index_ = nullptr;
+        throw_errno("mmap " + index_path);
+    }
+    if (!usable) {
+        // A new cache, or one sized for a different budget; its segments
+        // can't be found without a matching index
+        reset();
+        log_info("Disk cache at ", dir_, ": created, ", max_bytes_ / (1024 * 1024), " MB budget");
+        return;
+    }
+    auto* header = static_cast<IndexHeader*>(index_);
+
+    // Only the directory listing; segment contents are read on demand
+    uint32_t newest = 0;
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+        uint32_t id = segment_id(entry.path());
+        if (id == 0) continue;
+        auto segment = std::make_shared<Segment>();
+        segment->id = id;
+        segment->fd = ::open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (segment->fd < 0) continue;
+        segment->size = static_cast<uint64_t>(entry.file_size());
+        bytes_ += segment->size;
+        segments_[id] = std::move(segment);
+        newest = std::max(newest, id);
+    }
+    next_segment_ = std::max(header->next_segment, newest + 1);
+    header->next_segment = next_segment_;
+    while (bytes_ > max_bytes_ && !segments_.empty()) {
+        evict_oldest();
+    }
+    log_info("Disk cache at ", dir_, ": ", segments_.size(), " segments, ", bytes_ / (1024 * 1024), " MB");
+}
+
+void DiskCache::close() {
+    if (index_) ::munmap(index_, index_bytes_);
+    if (index_fd_ >= 0) ::close(index_fd_);
+    index_ = nullptr;
+    index_fd_ = -1;
+}
+
+DiskCache::Slot* DiskCache::slot_at(uint64_t digest, size_t probe) const {
+    auto* slots = reinterpret_cast<Slot*>(static_cast<char*>(index_) + INDEX_HEADER_BYTES);
+    return &slots[(digest + probe) & (slot_count_ - 1)];
+}
+
+bool DiskCache::is_live(const Slot& slot) const {
+    return slot.segment != 0 && segments_.count(slot.segment) > 0;
+}
+
+std::string DiskCache::segment_path(uint32_t id) const {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%08u%s", id, SEGMENT_SUFFIX);
+    return (fs::path(dir_) / name).string();
+}
+
+std::shared_ptr<const SharedBuffer> DiskCache::get(const ThumbnailKey& key) {
+    uint64_t digest = key.digest() | 1; // never 0, so a zeroed slot never matches
+
+    Slot found{};
+    std::shared_ptr<Segment> segment;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+            const Slot* slot = slot_at(digest, probe);
+            if (slot->segment == 0) break;
+            if (slot->digest == digest && is_live(*slot)) {
+                found = *slot;
+                segment = segments_[slot->segment];
+                break;
+            }
+        }
+    }
+    if (!segment) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // Read outside the lock; an evicted segment stays readable until the
+    // last reader drops it
+    RecordHeader header;
+    std::string params(key.params.size(), '\0');
+    void* value = g_malloc(found.value_size ? found.value_size : 1);
+    iovec parts[] = {
+        {&header, sizeof(header)},
+        {&params[0], params.size()},
+        {value, found.value_size},
+    };
+    ssize_t expected = static_cast<ssize_t>(sizeof(header) + params.size() + found.value_size);
+    bool valid = ::preadv(segment->fd, parts, 3, static_cast<off_t>(found.offset)) == expected &&
+                 header.magic == RECORD_MAGIC &&
+                 header.params_size == params.size() &&
+                 header.content_hash == key.content_hash &&
+                 header.content_size == key.content_size &&
+                 header.value_size == found.value_size &&
+                 params == key.params &&
+                 header.value_hash == Hasher::hash(value, found.value_size);
+    if (!valid) {
+        g_free(value);
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return SharedBuffer::adopt(value, found.value_size);
+}
+
+void DiskCache::put(const ThumbnailKey& key, const SharedBuffer& value) {
+    uint64_t record_size = sizeof(RecordHeader) + key.params.size() + value.size();
+    if (record_size > segment_bytes_ / 4) {
+        return;
+    }
+    RecordHeader header{RECORD_MAGIC, static_cast<uint32_t>(key.params.size()), key.content_hash,
+                        key.content_size, value.size(), Hasher::hash(value.data(), value.size())};
+    iovec parts[] = {
+        {&header, sizeof(header)},
+        {const_cast<char*>(key.params.data()), key.params.size()},
+        {const_cast<uint8_t*>(value.data()), value.size()},
+    };
+    uint64_t digest = key.digest() | 1;
+
+    // Claim space at the end of the active segment, then write without the
+    // lock so lookups never wait on the disk
+    std::shared_ptr<Segment> segment;
+    uint64_t offset = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto active = segments_.find(active_segment_);
+        if (active == segments_.end() || active->second->size + record_size > segment_bytes_) {
+            if (!roll_segment()) {
+                return;
+            }
+            active = segments_.find(active_segment_);
+        }
+        segment = active->second;
+        offset = segment->size;
+        segment->size += record_size;
+        bytes_ += record_size;
+    }
+    if (::pwritev(segment->fd, parts, 3, static_cast<off_t>(offset)) != static_cast<ssize_t>(record_size)) {
+        // The claimed space is left as a hole no slot points at
+        log_warn("Disk cache write failed: ", std::strerror(errno));
+        return;
+    }
+
+    // Published only once the record is complete, and only if its segment
+    // wasn't evicted while it was being written
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (segments_.count(segment->id) == 0) {
+        return;
+    }
+    // Take the key's own slot, else one that is free or points at a deleted
+    // segment, else overwrite the first candidate
+    Slot* target = nullptr;
+    for (size_t probe = 0; probe < MAX_PROBE && !target; ++probe) {
+        Slot* slot = slot_at(digest, probe);
+        if (slot->digest == digest || !is_live(*slot)) target = slot;
+    }
+    if (!target) target = slot_at(digest, 0);
+    *target = {digest, offset, segment->id, static_cast<uint32_t>(value.size())};
+}
+
+CacheStats DiskCache::stats() const {
+    CacheStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.capacity_bytes = max_bytes_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.bytes = bytes_;
+    return stats;
+}
+
+bool DiskCache::roll_segment() {
+    while (!segments_.empty() && bytes_ + segment_bytes_ > max_bytes_) {
+        evict_oldest();
+    }
+    uint32_t id = next_segment_++;
+    static_cast<IndexHeader*>(index_)->next_segment = next_segment_;
+
+    // Only segments opened this run are appended to, never one that a
+    // crash may have left with a torn tail
+    auto segment = std::make_shared<Segment>();
+    segment->id = id;
+    std::string path = segment_path(id);
+    segment->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment->fd < 0) {
+        log_warn("Cannot create disk cache segment ", path, ": ", std::strerror(errno));
+        return false;
+    }
+    segments_[id] = std::move(segment);
+    active_segment_ = id;
+    return true;
+}
+
+void DiskCache::evict_oldest() {
+    auto oldest = segments_.begin();
+    ::unlink(segment_path(oldest->first).c_str());
+    bytes_ -= oldest->second->size;
+    segments_.erase(oldest);
+}
+
+void DiskCache::reset() {
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+        if (segment_id(entry.path()) != 0) {
+            std::error_code ec;
+            fs::remove(entry.path(), ec);
+        }
+    }
+    segments_.clear();
+    bytes_ = 0;
+    auto* header = static_cast<IndexHeader*>(index_);
+    header->magic = INDEX_MAGIC;
+    header->slot_count = slot_count_;
+    header->next_segment = next_segment_;
+}
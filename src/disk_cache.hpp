@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "metrics.hpp"
+#include "result_cache.hpp"
+#include "shared_buffer.hpp"
+
+// Second cache tier behind ResultCache, on local disk, so encoded
+// thumbnails survive restarts.
+//
+// Thumbnails are appended to numbered segment files; when the budget is
+// reached the oldest segment is deleted whole (FIFO). An open-addressed hash
+// table in a memory-mapped index file points at the newest record for each
+// key. Opening is just mapping that index and listing the segments, so a
+// restarted server serves immediately and faults index pages in as keys are
+// looked up. Nothing is trusted without checking: every record carries its
+// full key and a hash of the thumbnail, and a record that doesn't match
+// (torn by a crash, or in a segment that is gone) is a miss.
+//
+// Lookups and writes block on disk, so keep them off the I/O threads; the
+// server gives them threads of their own.
+class DiskCache {
+public:
+    // Throws std::system_error if the directory or index can't be set up
+    DiskCache(const std::string& dir, uint64_t max_bytes);
+    ~DiskCache();
+
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+
+    // Null on a miss
+    std::shared_ptr<const SharedBuffer> get(const ThumbnailKey& key);
+
+    // Best effort; a failed write only costs a future miss
+    void put(const ThumbnailKey& key, const SharedBuffer& value);
+
+    // entries and evictions aren't tracked, since that would mean scanning
+    // the segments at startup
+    CacheStats stats() const;
+
+private:
+    struct Segment {
+        uint32_t id = 0;
+        int fd = -1;
+        uint64_t size = 0;
+        ~Segment();
+    };
+
+    struct Slot;
+
+    // Slots probed before a lookup gives up or an insert overwrites
+    static constexpr size_t MAX_PROBE = 16;
+
+    // Map the index and list the segments; close() undoes it
+    void open();
+    void close();
+
+    Slot* slot_at(uint64_t digest, size_t probe) const;
+    bool is_live(const Slot& slot) const;
+    std::string segment_path(uint32_t id) const;
+    // Called with mutex_ held
+    bool roll_segment();
+    void evict_oldest();
+    void reset();
+
+    std::string dir_;
+    uint64_t max_bytes_;
+    uint64_t segment_bytes_;
+
+    mutable std::mutex mutex_;
+    int index_fd_ = -1;
+    void* index_ = nullptr;
+    size_t index_bytes_ = 0;
+    size_t slot_count_ = 0;
+    std::map<uint32_t, std::shared_ptr<Segment>> segments_; // oldest first
+    uint32_t next_segment_ = 1;
+    uint32_t active_segment_ = 0; // appended to; 0 until the first put
+    uint64_t bytes_ = 0;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
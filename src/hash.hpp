@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Streaming XXH64. Fast enough (several GB/s) to fingerprint uploads as
+// they are read, so cache lookups never need a second pass over the body.
+class Hasher {
+public:
+    explicit Hasher(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0) {
+        v1_ = seed + P1 + P2;
+        v2_ = seed + P2;
+        v3_ = seed;
+        v4_ = seed - P1;
+        seed_ = seed;
+        total_ = 0;
+        buffered_ = 0;
+    }
+
+    void update(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + size;
+        total_ += size;
+
+        // Top up a partial stripe left from the previous call
+        if (buffered_ + size < 32) {
+            std::memcpy(buffer_ + buffered_, p, size);
+            buffered_ += size;
+            return;
+        }
+        if (buffered_ > 0) {
+            size_t fill = 32 - buffered_;
+            std::memcpy(buffer_ + buffered_, p, fill);
+            consume_stripe(buffer_);
+            p += fill;
+            buffered_ = 0;
+        }
+
+        while (end - p >= 32) {
+            consume_stripe(p);
+            p += 32;
+        }
+
+        buffered_ = static_cast<size_t>(end - p);
+        std::memcpy(buffer_, p, buffered_);
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total_ >= 32) {
+            h = rotl(v1_, 1) + rotl(v2_, 7) + rotl(v3_, 12) + rotl(v4_, 18);
+            h = merge_round(h, v1_);
+            h = merge_round(h, v2_);
+            h = merge_round(h, v3_);
+            h = merge_round(h, v4_);
+        } else {
+            h = seed_ + P5;
+        }
+        h += total_;
+
+        const uint8_t* p = buffer_;
+        const uint8_t* end = buffer_ + buffered_;
+        while (end - p >= 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+            p += 8;
+        }
+        if (end - p >= 4) {
+            h ^= static_cast<uint64_t>(read32(p)) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+        }
+        while (p < end) {
+            h ^= (*p) * P5;
+            h = rotl(h, 11) * P1;
+            ++p;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0) {
+        Hasher hasher(seed);
+        hasher.update(data, size);
+        return hasher.digest();
+    }
+
+private:
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t read64(const uint8_t* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v)); // little-endian hosts only
+        return v;
+    }
+
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+
+    static uint64_t merge_round(uint64_t acc, uint64_t val) {
+        acc ^= round(0, val);
+        return acc * P1 + P4;
+    }
+
+    void consume_stripe(const uint8_t* p) {
+        v1_ = round(v1_, read64(p));
+        v2_ = round(v2_, read64(p + 8));
+        v3_ = round(v3_, read64(p + 16));
+        v4_ = round(v4_, read64(p + 24));
+    }
+
+    uint64_t v1_, v2_, v3_, v4_;
+    uint64_t seed_;
+    uint64_t total_;
+    uint8_t buffer_[32];
+    size_t buffered_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Point-in-time copy of a LatencyHistogram, merged across stripes
+struct HistogramSnapshot {
+    static constexpr int MIN_SHIFT = 6;   // first bucket is [0, 64]
+    static constexpr int MAX_SHIFT = 26;  // last finite bound is 2^26 (~67 s in microseconds)
+    // Linear sub-buckets per power of two: 2^SUB_BITS. Eight keep every bucket
+    // within 12.5% of its values, fine enough that the 50 ms goal and the p99
+    // read from these bounds don't jump with a few slow samples, at 161 bounds
+    // per exported series.
+    static constexpr int SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BITS;
+    static constexpr size_t BOUNDS = 1 + (MAX_SHIFT - MIN_SHIFT) * SUB_BUCKETS;
+    static constexpr size_t BUCKETS = BOUNDS + 1; // plus the overflow (+Inf) bucket
+
+    // Inclusive upper bound of a finite bucket
+    static constexpr uint64_t upper_bound(size_t index) {
+        if (index == 0) return uint64_t(1) << MIN_SHIFT;
+        size_t octave = MIN_SHIFT + (index - 1) / SUB_BUCKETS;
+        size_t sub = (index - 1) % SUB_BUCKETS;
+        return (uint64_t(1) << octave) + (sub + 1) * (uint64_t(1) << (octave - SUB_BITS));
+    }
+
+    // Bucket whose range holds value, BOUNDS for the overflow bucket
+    static size_t bucket_for(uint64_t value) {
+        if (value <= (uint64_t(1) << MIN_SHIFT)) return 0;
+        // value <= bound is value - 1 < bound, which splits cleanly on bits
+        uint64_t v = value - 1;
+        int octave = 63 - __builtin_clzll(v);
+        if (octave >= MAX_SHIFT) return BOUNDS;
+        size_t sub = static_cast<size_t>(v >> (octave - SUB_BITS)) & (SUB_BUCKETS - 1);
+        return 1 + static_cast<size_t>(octave - MIN_SHIFT) * SUB_BUCKETS + sub;
+    }
+
+    // Estimate by linear interpolation inside the bucket holding the rank,
+    // as Prometheus' histogram_quantile() does
+    double quantile(double q) const {
+        if (count == 0) return 0.0;
+        double rank = q * static_cast<double>(count);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BOUNDS; ++i) {
+            if (counts[i] == 0) continue;
+            if (static_cast<double>(seen + counts[i]) >= rank) {
+                double lower = i == 0 ? 0.0 : static_cast<double>(upper_bound(i - 1));
+                double upper = static_cast<double>(upper_bound(i));
+                double within = (rank - static_cast<double>(seen)) / static_cast<double>(counts[i]);
+                return lower + (upper - lower) * within;
+            }
+            seen += counts[i];
+        }
+        return static_cast<double>(upper_bound(BOUNDS - 1));
+    }
+
+    std::array<uint64_t, BUCKETS> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+};
+
+// Log-linear histogram of non-negative integer samples (microseconds here).
+// Each power of two is split into equal linear sub-buckets, so the relative
+// error is bounded at every scale with a fixed, small bucket set. Recording
+// is a relaxed atomic add on a stripe picked per thread: wait-free, and
+// threads rarely share a cache line. Stripes are summed at scrape time.
+class LatencyHistogram {
+public:
+    void record(int64_t value) {
+        uint64_t v = value > 0 ? static_cast<uint64_t>(value) : 0;
+        Stripe& stripe = stripes_[stripe_index()];
+        stripe.counts[HistogramSnapshot::bucket_for(v)].fetch_add(1, std::memory_order_relaxed);
+        stripe.sum.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot snap;
+        for (const auto& stripe : stripes_) {
+            for (size_t i = 0; i < HistogramSnapshot::BUCKETS; ++i) {
+                snap.counts[i] += stripe.counts[i].load(std::memory_order_relaxed);
+            }
+            snap.sum += stripe.sum.load(std::memory_order_relaxed);
+        }
+        // Derived from the buckets so _count always equals the +Inf bucket
+        for (uint64_t c : snap.counts) snap.count += c;
+        return snap;
+    }
+
+private:
+    static constexpr size_t STRIPES = 8;
+
+    struct alignas(64) Stripe {
+        std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKETS> counts{};
+        std::atomic<uint64_t> sum{0};
+    };
+
+    static size_t stripe_index() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+        return index;
+    }
+
+    std::array<Stripe, STRIPES> stripes_;
+};
@@ -0,0 +1,184 @@
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+const char* level_name(LogLevel level) {
+    switch (level) {
+    case LogLevel::debug: return "DEBUG";
+    case LogLevel::info:  return "INFO ";
+    case LogLevel::warn:  return "WARN ";
+    case LogLevel::error: return "ERROR";
+    default:              return "";
+    }
+}
+
+// ISO 8601 UTC with milliseconds
+void append_timestamp(std::string& out, std::chrono::system_clock::time_point time) {
+    auto since_epoch = time.time_since_epoch();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch - seconds);
+    std::time_t t = static_cast<std::time_t>(seconds.count());
+    std::tm tm;
+    gmtime_r(&t, &tm);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    out += stamp;
+    char ms[8];
+    std::snprintf(ms, sizeof(ms), ".%03dZ", static_cast<int>(millis.count()));
+    out += ms;
+}
+
+} // namespace
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() {
+    drain_thread_ = std::thread([this] { drain_loop(); });
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(drain_mutex_);
+        stopping_ = true;
+    }
+    drain_cv_.notify_one();
+    if (drain_thread_.joinable()) {
+        drain_thread_.join();
+    }
+}
+
+std::optional<LogLevel> Logger::parse_level(std::string_view name) {
+    if (name == "debug") return LogLevel::debug;
+    if (name == "info") return LogLevel::info;
+    if (name == "warn") return LogLevel::warn;
+    if (name == "error") return LogLevel::error;
+    if (name == "off") return LogLevel::off;
+    return std::nullopt;
+}
+
+Logger::Ring& Logger::local_ring() {
+    // Registered on a thread's first log line; handed to the drain thread
+    // for cleanup when the thread exits
+    struct Owner {
+        std::shared_ptr<Ring> ring;
+        ~Owner() {
+            if (ring) ring->orphaned.store(true, std::memory_order_release);
+        }
+    };
+    thread_local Owner owner;
+    if (!owner.ring) {
+        owner.ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.push_back(owner.ring);
+    }
+    return *owner.ring;
+}
+
+void Logger::submit(LogLevel level, const Line& line) {
+    Ring& ring = local_ring();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= RING_CAPACITY) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Record& record = ring.slots[head % RING_CAPACITY];
+    record.time = std::chrono::system_clock::now();
+    record.level = level;
+    record.length = static_cast<uint16_t>(line.size());
+    std::memcpy(record.text, line.data(), line.size());
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(drain_mutex_);
+    uint64_t ticket = ++flush_requested_;
+    drain_cv_.notify_one();
+    flushed_cv_.wait(lock, [&] { return flush_completed_ >= ticket || stopping_; });
+}
+
+void Logger::drain_loop() {
+    std::unique_lock<std::mutex> lock(drain_mutex_);
+    while (true) {
+        drain_cv_.wait_for(lock, std::chrono::milliseconds(50), [this] {
+            return stopping_ || flush_requested_ > flush_completed_;
+        });
+        bool stopping = stopping_;
+        uint64_t requested = flush_requested_;
+        lock.unlock();
+
+        while (drain_once()) {
+        }
+
+        lock.lock();
+        flush_completed_ = requested;
+        flushed_cv_.notify_all();
+        if (stopping) return;
+    }
+}
+
+bool Logger::drain_once() {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings = rings_;
+    }
+
+    // Copy out everything published so far, then order it across threads
+    std::vector<Record> records;
+    std::vector<std::shared_ptr<Ring>> finished;
+    for (const auto& ring : rings) {
+        bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i < head; ++i) {
+            records.push_back(ring->slots[i % RING_CAPACITY]);
+        }
+        ring->tail.store(head, std::memory_order_release);
+        if (orphaned) finished.push_back(ring);
+    }
+    if (!finished.empty()) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (const auto& ring : finished) {
+            rings_.erase(std::remove(rings_.begin(), rings_.end(), ring), rings_.end());
+        }
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (records.empty() && dropped == reported_dropped_) {
+        return false;
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) { return a.time < b.time; });
+
+    std::string out, err;
+    for (const auto& record : records) {
+        std::string& target = record.level >= LogLevel::warn ? err : out;
+        append_timestamp(target, record.time);
+        target += ' ';
+        target += level_name(record.level);
+        target += ' ';
+        target.append(record.text, record.length);
+        target += '\n';
+    }
+    if (dropped != reported_dropped_) {
+        err += "Logger dropped " + std::to_string(dropped - reported_dropped_) + " lines (ring full)\n";
+        reported_dropped_ = dropped;
+    }
+
+    // One write per stream per pass
+    if (!out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+    if (!err.empty()) {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+        std::fflush(stderr);
+    }
+    return true;
+}
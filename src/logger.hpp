@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel { debug, info, warn, error, off };
+
+// Asynchronous leveled logger. Each thread formats into its own lock-free
+// ring buffer and a background thread drains the rings to stdout (debug,
+// info) and stderr (warn, error). Logging never blocks or makes a syscall
+// on the calling thread; if a ring is full the line is dropped and counted.
+class Logger {
+public:
+    static Logger& instance();
+
+    void set_level(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    LogLevel level() const { return level_.load(std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const { return level >= this->level() && level != LogLevel::off; }
+
+    // Concatenate the arguments into one line. Strings, characters,
+    // integers and floating point values are supported.
+    template <class... Args>
+    void write(LogLevel level, const Args&... args) {
+        Line line;
+        (line.append(args), ...);
+        submit(level, line);
+    }
+
+    // Block until everything logged so far has been written out
+    void flush();
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static std::optional<LogLevel> parse_level(std::string_view name);
+
+    ~Logger();
+
+private:
+    static constexpr size_t MAX_LINE = 240;
+    static constexpr size_t RING_CAPACITY = 1024;
+
+    // Fixed-size formatting buffer; long lines are truncated
+    class Line {
+    public:
+        void append(std::string_view text) {
+            size_t n = std::min(text.size(), MAX_LINE - length_);
+            std::memcpy(text_ + length_, text.data(), n);
+            length_ += n;
+        }
+        void append(const char* text) { append(std::string_view(text)); }
+        void append(const std::string& text) { append(std::string_view(text)); }
+        void append(char c) { append(std::string_view(&c, 1)); }
+
+        template <class T, class = std::enable_if_t<std::is_arithmetic_v<T>>>
+        void append(T value) {
+            if constexpr (std::is_same_v<T, bool>) {
+                append(value ? "true" : "false");
+            } else {
+                auto [end, ec] = std::to_chars(text_ + length_, text_ + MAX_LINE, value);
+                if (ec == std::errc()) length_ = static_cast<size_t>(end - text_);
+            }
+        }
+
+        const char* data() const { return text_; }
+        size_t size() const { return length_; }
+
+    private:
+        char text_[MAX_LINE];
+        size_t length_ = 0;
+    };
+
+    struct Record {
+        std::chrono::system_clock::time_point time;
+        LogLevel level;
+        uint16_t length;
+        char text[MAX_LINE];
+    };
+
+    // Single producer (the owning thread), single consumer (the drain thread)
+    struct Ring {
+        std::array<Record, RING_CAPACITY> slots;
+        std::atomic<uint64_t> head{0}; // next slot to write
+        std::atomic<uint64_t> tail{0}; // next slot to read
+        std::atomic<bool> orphaned{false}; // owning thread has exited
+    };
+
+    Logger();
+
+    void submit(LogLevel level, const Line& line);
+    Ring& local_ring();
+    void drain_loop();
+    // Returns false once there was nothing left to write
+    bool drain_once();
+
+    std::atomic<LogLevel> level_{LogLevel::info};
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t reported_dropped_ = 0;
+
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+
+    std::mutex drain_mutex_;
+    std::condition_variable drain_cv_;
+    std::condition_variable flushed_cv_;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_completed_ = 0;
+    bool stopping_ = false;
+    std::thread drain_thread_;
+};
+
+template <class... Args>
+void log_debug(const Args&... args) {
+    Logger& logger = Logger::instance();
+    if (logger.enabled(LogLevel::debug)) logger.write(LogLevel::debug, args...);
+}
+
+template <class... Args>
+void log_info(const Args&... args) {
+    Logger& logger = Logger::instance();
+    if (logger.enabled(LogLevel::info)) logger.write(LogLevel::info, args...);
+}
+
+template <class... Args>
+void log_warn(const Args&... args) {
+    Logger& logger = Logger::instance();
+    if (logger.enabled(LogLevel::warn)) logger.write(LogLevel::warn, args...);
+}
+
+template <class... Args>
+void log_error(const Args&... args) {
+    Logger& logger = Logger::instance();
+    if (logger.enabled(LogLevel::error)) logger.write(LogLevel::error, args...);
+}
@@ -2,6 +2,8 @@
 #include <signal.h>
 #include <thread>
 #include <atomic>
+#include <algorithm>
+#include "logger.hpp"
 #include "server.hpp"
 
 std::atomic<bool> running{true};
@@ -19,28 +21,131 @@ int main(int argc, char* argv[]) {
 
     try {
         // Parse command line arguments
-        int port = 8080;
-        int threads = std::thread::hardware_concurrency();
+        ServerConfig config;
+        config.thread_count = std::thread::hardware_concurrency();
+        config.worker_count = std::thread::hardware_concurrency();
+        bool queue_size_set = false;
         
         for (int i = 1; i < argc; i++) {
             std::string arg = argv[i];
             if (arg == "--port" && i + 1 < argc) {
-                port = std::stoi(argv[++i]);
+                config.port = std::stoi(argv[++i]);
             } else if (arg == "--threads" && i + 1 < argc) {
-                threads = std::stoi(argv[++i]);
+                config.thread_count = std::stoi(argv[++i]);
+            } else if (arg == "--workers" && i + 1 < argc) {
+                config.worker_count = std::stoi(argv[++i]);
+            } else if (arg == "--queue-size" && i + 1 < argc) {
+                config.max_queue = std::stoul(argv[++i]);
+                queue_size_set = true;
+            } else if (arg == "--max-inflight" && i + 1 < argc) {
+                config.max_inflight_uploads = std::stoul(argv[++i]);
+            } else if (arg == "--max-inflight-mb" && i + 1 < argc) {
+                config.max_inflight_bytes = std::stoull(argv[++i]) * 1024 * 1024;
+            } else if (arg == "--idle-timeout" && i + 1 < argc) {
+                config.idle_timeout = std::chrono::seconds(std::stoi(argv[++i]));
+            } else if (arg == "--max-requests" && i + 1 < argc) {
+                config.max_requests_per_connection = std::stoi(argv[++i]);
+            } else if (arg == "--max-edge" && i + 1 < argc) {
+                config.max_output_edge = std::stoi(argv[++i]);
+            } else if (arg == "--quality" && i + 1 < argc) {
+                config.encode_defaults.quality = std::stoi(argv[++i]);
+            } else if (arg == "--webp-effort" && i + 1 < argc) {
+                config.encode_defaults.webp_effort = std::stoi(argv[++i]);
+            } else if (arg == "--avif-effort" && i + 1 < argc) {
+                config.encode_defaults.avif_effort = std::stoi(argv[++i]);
+            } else if (arg == "--jxl-effort" && i + 1 < argc) {
+                config.encode_defaults.jxl_effort = std::stoi(argv[++i]);
+            } else if (arg == "--png-compression" && i + 1 < argc) {
+                config.encode_defaults.png_compression = std::stoi(argv[++i]);
+            } else if (arg == "--max-webp-effort" && i + 1 < argc) {
+                config.max_webp_effort = std::stoi(argv[++i]);
+            } else if (arg == "--max-avif-effort" && i + 1 < argc) {
+                config.max_avif_effort = std::stoi(argv[++i]);
+            } else if (arg == "--max-jxl-effort" && i + 1 < argc) {
+                config.max_jxl_effort = std::stoi(argv[++i]);
+            } else if (arg == "--encoder-threads" && i + 1 < argc) {
+                config.encoder_threads = std::stoi(argv[++i]);
+            } else if (arg == "--max-png-compression" && i + 1 < argc) {
+                config.max_png_compression = std::stoi(argv[++i]);
+            } else if (arg == "--no-lossless") {
+                config.allow_lossless = false;
+            } else if (arg == "--cache-mb" && i + 1 < argc) {
+                config.cache_bytes = std::stoull(argv[++i]) * 1024 * 1024;
+            } else if (arg == "--disk-cache-dir" && i + 1 < argc) {
+                config.disk_cache_dir = argv[++i];
+            } else if (arg == "--disk-cache-mb" && i + 1 < argc) {
+                config.disk_cache_bytes = std::stoull(argv[++i]) * 1024 * 1024;
+            } else if (arg == "--disk-cache-threads" && i + 1 < argc) {
+                config.disk_cache_threads = std::stoi(argv[++i]);
+            } else if (arg == "--local-root" && i + 1 < argc) {
+                config.local_root = argv[++i];
+            } else if (arg == "--log-level" && i + 1 < argc) {
+                auto level = Logger::parse_level(argv[++i]);
+                if (!level) {
+                    std::cerr << "--log-level must be debug, info, warn, error or off" << std::endl;
+                    return 1;
+                }
+                Logger::instance().set_level(*level);
             } else if (arg == "--help") {
-                std::cout << "Usage: " << argv[0] << " [--port PORT] [--threads THREADS]" << std::endl;
+                std::cout << "Usage: " << argv[0] << " [--port PORT] [--threads THREADS] [options]" << std::endl;
                 std::cout << "  --port PORT     Port to listen on (default: 8080)" << std::endl;
                 std::cout << "  --threads THREADS Number of worker threads (default: CPU cores)" << std::endl;
+                std::cout << "  --workers N     Image processing threads (default: CPU cores)" << std::endl;
+                std::cout << "  --queue-size N  Jobs allowed to wait for a worker (default: 4 x workers)" << std::endl;
+                std::cout << "  --max-inflight N Uploads admitted at once before shedding with 503 (default: workers + queue size)" << std::endl;
+                std::cout << "  --max-inflight-mb MB Upload bytes admitted at once (default: 512)" << std::endl;
+                std::cout << "  --idle-timeout SECONDS Close idle keep-alive connections (default: 30)" << std::endl;
+                std::cout << "  --max-requests N Requests served per connection, 0 = unlimited (default: 1000)" << std::endl;
+                std::cout << "  --max-edge PX   Largest thumbnail width or height that may be requested (default: 2048)" << std::endl;
+                std::cout << "  --quality Q     Default JPEG/WebP/AVIF/JXL quality, 1-100 (default: 90)" << std::endl;
+                std::cout << "  --webp-effort N Default WebP effort, 0-6 (default: 4)" << std::endl;
+                std::cout << "  --avif-effort N Default AVIF effort, 0-9 (default: 4)" << std::endl;
+                std::cout << "  --jxl-effort N  Default JPEG XL effort, 1-9 (default: 7)" << std::endl;
+                std::cout << "  --png-compression N Default PNG zlib level, 0-9 (default: 6)" << std::endl;
+                std::cout << "  --max-webp-effort N Highest WebP effort a request may ask for (default: 6)" << std::endl;
+                std::cout << "  --max-avif-effort N Highest AVIF effort a request may ask for (default: 9)" << std::endl;
+                std::cout << "  --max-jxl-effort N Highest JPEG XL effort a request may ask for (default: 9)" << std::endl;
+                std::cout << "  --encoder-threads N Threads each image may use while encoding (default: cores / workers)" << std::endl;
+                std::cout << "  --max-png-compression N Highest PNG level a request may ask for (default: 9)" << std::endl;
+                std::cout << "  --no-lossless   Refuse lossless=true requests" << std::endl;
+                std::cout << "  --log-level LEVEL debug (includes per-request timing), info, warn, error or off (default: info)" << std::endl;
+                std::cout << "  --cache-mb MB   Memory for cached thumbnails, 0 = disabled (default: 256)" << std::endl;
+                std::cout << "  --disk-cache-dir DIR Keep cached thumbnails in DIR across restarts (default: memory only)" << std::endl;
+                std::cout << "  --disk-cache-mb MB Disk space for the disk cache (default: 4096)" << std::endl;
+                std::cout << "  --disk-cache-threads N Threads for disk cache reads and writes (default: 2)" << std::endl;
+                std::cout << "  --local-root DIR Serve GET /thumb?path= from files under DIR (default: disabled)" << std::endl;
                 return 0;
             }
         }
 
-        std::cout << "Starting ThumbnailGen service on port " << port 
-                  << " with " << threads << " threads" << std::endl;
+        if (!queue_size_set) {
+            config.max_queue = 4 * static_cast<size_t>(std::max(config.worker_count, 1));
+        }
+
+        // Keep the defaults inside the ranges requests are held to
+        EncodeOptions& defaults = config.encode_defaults;
+        defaults.quality = std::clamp(defaults.quality, 1, 100);
+        config.max_webp_effort = std::clamp(config.max_webp_effort, 0, 6);
+        config.max_png_compression = std::clamp(config.max_png_compression, 0, 9);
+        config.max_avif_effort = std::clamp(config.max_avif_effort, 0, 9);
+        config.max_jxl_effort = std::clamp(config.max_jxl_effort, 1, 9);
+        defaults.avif_effort = std::clamp(defaults.avif_effort, 0, config.max_avif_effort);
+        defaults.jxl_effort = std::clamp(defaults.jxl_effort, 1, config.max_jxl_effort);
+        defaults.webp_effort = std::clamp(defaults.webp_effort, 0, config.max_webp_effort);
+        defaults.png_compression = std::clamp(defaults.png_compression, 0, config.max_png_compression);
+
+        // Every worker may be encoding at once; split the cores between them
+        if (config.encoder_threads <= 0) {
+            int cores = static_cast<int>(std::thread::hardware_concurrency());
+            config.encoder_threads = std::max(1, cores / std::max(config.worker_count, 1));
+        }
+
+        log_info("Starting ThumbnailGen service on port ", config.port,
+                 " with ", config.thread_count, " threads and ",
+                 config.worker_count, " processing workers");
 
         // Create and run server
-        ThumbnailServer server(port, threads);
+        ThumbnailServer server(config);
         server.run();
 
         // Wait for shutdown signal
@@ -48,14 +153,16 @@ int main(int argc, char* argv[]) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
 
-        std::cout << "Shutting down server..." << std::endl;
+        log_info("Shutting down server...");
         server.stop();
 
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        log_error("Error: ", e.what());
+        Logger::instance().flush();
         return 1;
     }
 
-    std::cout << "Server stopped successfully" << std::endl;
+    log_info("Server stopped successfully");
+    Logger::instance().flush();
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+
+[[noreturn]] void throw_errno(int error, const std::string& what) {
+    throw std::system_error(error, std::generic_category(), what);
+}
+
+} // namespace
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string& path, uint64_t max_size) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        throw_errno(errno, "open " + path);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw_errno(error, "stat " + path);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ::close(fd);
+        throw_errno(S_ISDIR(st.st_mode) ? EISDIR : EINVAL, path + " is not a regular file");
+    }
+    if (static_cast<uint64_t>(st.st_size) > max_size) {
+        ::close(fd);
+        throw_errno(EFBIG, path + " is too large");
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->size_ = static_cast<size_t>(st.st_size);
+    file->device_ = static_cast<uint64_t>(st.st_dev);
+    file->inode_ = static_cast<uint64_t>(st.st_ino);
+    file->mtime_ = st.st_mtim.tv_sec;
+    file->mtime_nanoseconds_ = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+    if (file->size_ > 0 && file->size_ <= COPY_BYTES) {
+        // A file that shrinks from here on just reads short
+        void* data = std::malloc(file->size_);
+        size_t read = 0;
+        while (data && read < file->size_) {
+            ssize_t n = ::pread(fd, static_cast<char*>(data) + read, file->size_ - read, static_cast<off_t>(read));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                int error = errno;
+                std::free(data);
+                ::close(fd);
+                throw_errno(error, "read " + path);
+            }
+            if (n == 0) break;
+            read += static_cast<size_t>(n);
+        }
+        if (!data) {
+            ::close(fd);
+            throw_errno(ENOMEM, "read " + path);
+        }
+        file->data_ = data;
+        file->size_ = read;
+    } else if (file->size_ > 0) {
+        // mmap refuses a zero length; an empty file simply has no data
+        void* data = ::mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            int error = errno;
+            ::close(fd);
+            throw_errno(error, "mmap " + path);
+        }
+        file->data_ = data;
+        file->mapped_ = true;
+        // Decoders read front to back; start the readahead now
+        ::madvise(data, file->size_, MADV_SEQUENTIAL);
+        ::madvise(data, file->size_, MADV_WILLNEED);
+    }
+    // A mapping keeps the file open by itself
+    ::close(fd);
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (mapped_) {
+        ::munmap(data_, size_);
+    } else {
+        std::free(data_);
+    }
+}
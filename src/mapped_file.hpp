@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+
+// A whole file mapped read-only. libvips decodes straight out of the mapped
+// pages, so a local original is never copied onto the heap, and pages the
+// decoder skips are never read from disk. Files up to COPY_BYTES are read
+// into memory instead, where a copy costs less than setting up a mapping.
+//
+// Originals must not shrink while mapped: touching a page past the new end
+// of the file raises SIGBUS, which kills the process. Replace files by
+// renaming a new one into place, never by truncating or rewriting them.
+class MappedFile {
+public:
+    static constexpr size_t COPY_BYTES = 256 * 1024;
+
+    // Throws std::system_error with the errno of the failing call; a path
+    // that isn't a regular file fails with EISDIR or EINVAL, and one larger
+    // than max_size with EFBIG before anything is mapped. The final
+    // component must not be a symlink.
+    static std::shared_ptr<const MappedFile> open(const std::string& path, uint64_t max_size);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(data_); }
+    size_t size() const { return size_; }
+
+    // From fstat on the descriptor that was mapped, so they describe these
+    // bytes even if the path has since been replaced
+    uint64_t device() const { return device_; }
+    uint64_t inode() const { return inode_; }
+    std::time_t mtime() const { return mtime_; }
+    int64_t mtime_nanoseconds() const { return mtime_nanoseconds_; }
+
+private:
+    MappedFile() = default;
+
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    uint64_t device_ = 0;
+    uint64_t inode_ = 0;
+    std::time_t mtime_ = 0;
+    int64_t mtime_nanoseconds_ = 0;
+};
@@ -1,36 +1,148 @@
 #include "metrics.hpp"
 #include <sstream>
-#include <algorithm>
-#include <numeric>
 #include <iomanip>
+#include <iterator>
+#include <memory>
+
+namespace {
+
+constexpr const char* FAILURE_CLASS_NAMES[] = {"bad_request", "bad_multipart", "unsupported_format",
+                                               "too_large", "decode", "timeout", "shed"};
+
+constexpr const char* RESULT_SOURCE_NAMES[] = {"processed", "memory_cache", "disk_cache", "coalesced"};
+
+// Label values, in the order of the StageLabels indices
+constexpr const char* STAGE_NAMES[] = {"read", "parse", "decode", "resize", "encode", "write"};
+constexpr const char* INPUT_FORMAT_NAMES[] = {"jpeg", "png", "webp", "gif", "tiff", "heif", "jxl", "svg", "other"};
+constexpr const char* OUTPUT_FORMAT_NAMES[] = {"jpeg", "webp", "png", "avif", "jxl", "mixed"};
+constexpr const char* SIZE_CLASS_NAMES[] = {"small", "medium", "large", "xlarge"};
+
+template <size_t N>
+uint8_t index_of(const char* const (&names)[N], std::string_view name) {
+    for (size_t i = 0; i + 1 < N; ++i) {
+        if (name == names[i]) return static_cast<uint8_t>(i);
+    }
+    return static_cast<uint8_t>(N - 1); // the catch-all is last
+}
+
+void write_histogram_header(std::ostringstream& oss, const char* name, const char* help) {
+    oss << "# HELP " << name << " " << help << "\n";
+    oss << "# TYPE " << name << " histogram\n";
+}
+
+// labels is empty or a comma-terminated list such as stage="read",
+void write_histogram(std::ostringstream& oss, const char* name, const std::string& labels,
+                     const HistogramSnapshot& snap) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < HistogramSnapshot::BOUNDS; ++i) {
+        cumulative += snap.counts[i];
+        oss << name << "_bucket{" << labels << "le=\"" << HistogramSnapshot::upper_bound(i) << "\"} "
+            << cumulative << "\n";
+    }
+    oss << name << "_bucket{" << labels << "le=\"+Inf\"} " << snap.count << "\n";
+    std::string bare = labels.empty() ? "" : "{" + labels.substr(0, labels.size() - 1) + "}";
+    oss << name << "_sum" << bare << " " << snap.sum << "\n";
+    oss << name << "_count" << bare << " " << snap.count << "\n";
+}
+
+} // namespace
 
 MetricsCollector::MetricsCollector() {
 }
 
-void MetricsCollector::record_request(int64_t total_microseconds, int64_t processing_microseconds) {
+MetricsCollector::~MetricsCollector() {
+    for (auto& slot : stage_times_) {
+        delete slot.load(std::memory_order_acquire);
+    }
+}
+
+StageLabels MetricsCollector::stage_labels(std::string_view input_format, std::string_view output_format,
+                                           uint64_t input_bytes) {
+    static_assert(std::size(STAGE_NAMES) == STAGES && std::size(INPUT_FORMAT_NAMES) == INPUT_FORMATS &&
+                  std::size(OUTPUT_FORMAT_NAMES) == OUTPUT_FORMATS && std::size(SIZE_CLASS_NAMES) == SIZE_CLASSES,
+                  "label tables must match the sizes in metrics.hpp");
+    StageLabels labels;
+    labels.input_format = index_of(INPUT_FORMAT_NAMES, input_format);
+    labels.output_format = index_of(OUTPUT_FORMAT_NAMES, output_format);
+    labels.size_class = input_bytes <= 256 * 1024 ? 0
+                      : input_bytes <= 2 * 1024 * 1024 ? 1
+                      : input_bytes <= 8 * 1024 * 1024 ? 2 : 3;
+    return labels;
+}
+
+size_t MetricsCollector::stage_index(Stage stage, const StageLabels& labels) {
+    return ((static_cast<size_t>(stage) * INPUT_FORMATS + labels.input_format) * OUTPUT_FORMATS +
+            labels.output_format) * SIZE_CLASSES + labels.size_class;
+}
+
+void MetricsCollector::record_stage(Stage stage, const StageLabels& labels, int64_t microseconds) {
+    std::atomic<LatencyHistogram*>& slot = stage_times_[stage_index(stage, labels)];
+    LatencyHistogram* histogram = slot.load(std::memory_order_acquire);
+    if (!histogram) {
+        // Whoever installs first wins; a losing thread records into the winner's
+        auto created = std::make_unique<LatencyHistogram>();
+        if (slot.compare_exchange_strong(histogram, created.get(), std::memory_order_acq_rel)) {
+            histogram = created.release();
+        }
+    }
+    histogram->record(microseconds);
+}
+
+void MetricsCollector::record_bytes(const StageLabels& labels, uint64_t input_bytes, uint64_t output_bytes) {
+    input_bytes_[labels.input_format * SIZE_CLASSES + labels.size_class].fetch_add(
+        input_bytes, std::memory_order_relaxed);
+    output_bytes_[labels.output_format * SIZE_CLASSES + labels.size_class].fetch_add(
+        output_bytes, std::memory_order_relaxed);
+}
+
+void MetricsCollector::record_request(ResultSource source, int64_t total_microseconds,
+                                      int64_t processing_microseconds) {
+    static_assert(std::size(RESULT_SOURCE_NAMES) == RESULT_SOURCES,
+                  "result source names must match ResultSource");
     total_requests_++;
     successful_requests_++;
-    
-    std::lock_guard<std::mutex> lock(timing_mutex_);
-    add_timing_sample(total_times_, total_microseconds);
-    add_timing_sample(processing_times_, processing_microseconds);
+    served_[static_cast<size_t>(source)].fetch_add(1, std::memory_order_relaxed);
+    total_times_.record(total_microseconds);
+    if (source == ResultSource::processed) {
+        processing_times_.record(processing_microseconds);
+    }
 }
 
-void MetricsCollector::add_timing_sample(std::vector<int64_t>& samples, int64_t value) {
-    samples.push_back(value);
-    if (samples.size() > MAX_SAMPLES) {
-        samples.erase(samples.begin());
+void MetricsCollector::record_failure(FailureClass failure, int64_t total_microseconds) {
+    static_assert(std::size(FAILURE_CLASS_NAMES) == FAILURE_CLASSES,
+                  "failure class names must match FailureClass");
+    total_requests_++;
+    failed_requests_++;
+    if (failure == FailureClass::shed) {
+        shed_requests_++;
     }
+    size_t index = static_cast<size_t>(failure);
+    failures_[index].fetch_add(1, std::memory_order_relaxed);
+    failed_times_[index].record(total_microseconds);
 }
 
-double MetricsCollector::calculate_percentile(const std::vector<int64_t>& samples, double percentile) const {
-    if (samples.empty()) return 0.0;
-    
-    std::vector<int64_t> sorted_samples = samples;
-    std::sort(sorted_samples.begin(), sorted_samples.end());
-    
-    size_t index = static_cast<size_t>(percentile * (sorted_samples.size() - 1));
-    return static_cast<double>(sorted_samples[index]);
+void MetricsCollector::record_disk_lookup(bool hit, int64_t microseconds) {
+    (hit ? disk_hit_times_ : disk_miss_times_).record(microseconds);
+}
+
+void MetricsCollector::record_coalesced() {
+    coalesced_requests_++;
+}
+
+void MetricsCollector::update_load(size_t queue_depth, size_t in_flight_uploads, uint64_t in_flight_bytes) {
+    queue_depth_ = static_cast<int64_t>(queue_depth);
+    in_flight_uploads_ = static_cast<int64_t>(in_flight_uploads);
+    in_flight_bytes_ = static_cast<int64_t>(in_flight_bytes);
+}
+
+void MetricsCollector::update_cache(const CacheStats& stats) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    memory_cache_ = stats;
+}
+
+void MetricsCollector::update_disk_cache(const CacheStats& stats) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    disk_cache_ = stats;
 }
 
 std::string MetricsCollector::get_prometheus_metrics() const {
@@ -49,56 +161,167 @@ std::string MetricsCollector::get_prometheus_metrics() const {
     oss << "# TYPE thumbnail_requests_failed_total counter\n";
     oss << "thumbnail_requests_failed_total " << failed_requests_.load() << "\n\n";
     
+    oss << "# HELP thumbnail_requests_served_total Successful requests by where the thumbnail came from\n";
+    oss << "# TYPE thumbnail_requests_served_total counter\n";
+    for (size_t i = 0; i < RESULT_SOURCES; ++i) {
+        oss << "thumbnail_requests_served_total{source=\"" << RESULT_SOURCE_NAMES[i] << "\"} "
+            << served_[i].load(std::memory_order_relaxed) << "\n";
+    }
+    oss << "\n";
+    
+    oss << "# HELP thumbnail_request_failures_total Failed requests by cause\n";
+    oss << "# TYPE thumbnail_request_failures_total counter\n";
+    for (size_t i = 0; i < FAILURE_CLASSES; ++i) {
+        oss << "thumbnail_request_failures_total{class=\"" << FAILURE_CLASS_NAMES[i] << "\"} "
+            << failures_[i].load(std::memory_order_relaxed) << "\n";
+    }
+    oss << "\n";
+    
+    oss << "# HELP thumbnail_requests_shed_total Requests rejected with 503 because the server was saturated\n";
+    oss << "# TYPE thumbnail_requests_shed_total counter\n";
+    oss << "thumbnail_requests_shed_total " << shed_requests_.load() << "\n\n";
+    
+    oss << "# HELP thumbnail_requests_coalesced_total Requests that shared the result of an identical job already running\n";
+    oss << "# TYPE thumbnail_requests_coalesced_total counter\n";
+    oss << "thumbnail_requests_coalesced_total " << coalesced_requests_.load() << "\n\n";
+    
+    // Load gauges
+    oss << "# HELP thumbnail_queue_depth Jobs waiting for a processing worker\n";
+    oss << "# TYPE thumbnail_queue_depth gauge\n";
+    oss << "thumbnail_queue_depth " << queue_depth_.load() << "\n\n";
+    
+    oss << "# HELP thumbnail_inflight_uploads Uploads admitted and not yet answered\n";
+    oss << "# TYPE thumbnail_inflight_uploads gauge\n";
+    oss << "thumbnail_inflight_uploads " << in_flight_uploads_.load() << "\n\n";
+    
+    oss << "# HELP thumbnail_inflight_bytes Declared body bytes of admitted uploads\n";
+    oss << "# TYPE thumbnail_inflight_bytes gauge\n";
+    oss << "thumbnail_inflight_bytes " << in_flight_bytes_.load() << "\n\n";
+    
+    // Result cache; the disk tier only counts lookups and bytes
+    CacheStats cache;
+    std::optional<CacheStats> disk;
+    {
+        std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+        cache = memory_cache_;
+        disk = disk_cache_;
+    }
+    oss << "# HELP thumbnail_cache_hits_total Thumbnails served from the result cache\n";
+    oss << "# TYPE thumbnail_cache_hits_total counter\n";
+    oss << "thumbnail_cache_hits_total{tier=\"memory\"} " << cache.hits << "\n";
+    if (disk) oss << "thumbnail_cache_hits_total{tier=\"disk\"} " << disk->hits << "\n";
+    oss << "\n";
+    
+    oss << "# HELP thumbnail_cache_misses_total Result cache lookups that found nothing\n";
+    oss << "# TYPE thumbnail_cache_misses_total counter\n";
+    oss << "thumbnail_cache_misses_total{tier=\"memory\"} " << cache.misses << "\n";
+    if (disk) oss << "thumbnail_cache_misses_total{tier=\"disk\"} " << disk->misses << "\n";
+    oss << "\n";
+    
+    oss << "# HELP thumbnail_cache_evictions_total Entries dropped to stay within the cache budget\n";
+    oss << "# TYPE thumbnail_cache_evictions_total counter\n";
+    oss << "thumbnail_cache_evictions_total{tier=\"memory\"} " << cache.evictions << "\n\n";
+    
+    oss << "# HELP thumbnail_cache_entries Thumbnails currently cached\n";
+    oss << "# TYPE thumbnail_cache_entries gauge\n";
+    oss << "thumbnail_cache_entries{tier=\"memory\"} " << cache.entries << "\n\n";
+    
+    oss << "# HELP thumbnail_cache_bytes Bytes held by cached thumbnails\n";
+    oss << "# TYPE thumbnail_cache_bytes gauge\n";
+    oss << "thumbnail_cache_bytes{tier=\"memory\"} " << cache.bytes << "\n";
+    if (disk) oss << "thumbnail_cache_bytes{tier=\"disk\"} " << disk->bytes << "\n";
+    oss << "\n";
+    
+    oss << "# HELP thumbnail_cache_capacity_bytes Configured cache budget\n";
+    oss << "# TYPE thumbnail_cache_capacity_bytes gauge\n";
+    oss << "thumbnail_cache_capacity_bytes{tier=\"memory\"} " << cache.capacity_bytes << "\n";
+    if (disk) oss << "thumbnail_cache_capacity_bytes{tier=\"disk\"} " << disk->capacity_bytes << "\n";
+    oss << "\n";
+    
     // Timing histograms
-    std::lock_guard<std::mutex> lock(timing_mutex_);
+    HistogramSnapshot total = total_times_.snapshot();
+    write_histogram_header(oss, "thumbnail_request_duration_microseconds",
+                           "Duration of successful requests in microseconds");
+    write_histogram(oss, "thumbnail_request_duration_microseconds", "", total);
+    oss << "\n";
+    write_histogram_header(oss, "thumbnail_processing_duration_microseconds",
+                           "Image processing duration in microseconds");
+    write_histogram(oss, "thumbnail_processing_duration_microseconds", "", processing_times_.snapshot());
+    oss << "\n";
+    if (disk) {
+        write_histogram_header(oss, "thumbnail_disk_cache_lookup_duration_microseconds",
+                               "Disk cache tier lookups by result, in microseconds");
+        write_histogram(oss, "thumbnail_disk_cache_lookup_duration_microseconds", "result=\"hit\",",
+                        disk_hit_times_.snapshot());
+        write_histogram(oss, "thumbnail_disk_cache_lookup_duration_microseconds", "result=\"miss\",",
+                        disk_miss_times_.snapshot());
+        oss << "\n";
+    }
+    write_histogram_header(oss, "thumbnail_failed_request_duration_microseconds",
+                           "Time until a failed request was answered, in microseconds");
+    for (size_t i = 0; i < FAILURE_CLASSES; ++i) {
+        write_histogram(oss, "thumbnail_failed_request_duration_microseconds",
+                        std::string("class=\"") + FAILURE_CLASS_NAMES[i] + "\",", failed_times_[i].snapshot());
+    }
+    oss << "\n";
     
-    if (!total_times_.empty()) {
-        oss << "# HELP thumbnail_request_duration_microseconds Total request duration in microseconds\n";
-        oss << "# TYPE thumbnail_request_duration_microseconds histogram\n";
-        
-        double p50 = calculate_percentile(total_times_, 0.5);
-        double p95 = calculate_percentile(total_times_, 0.95);
-        double p99 = calculate_percentile(total_times_, 0.99);
-        
-        double sum = std::accumulate(total_times_.begin(), total_times_.end(), 0.0);
-        double mean = sum / total_times_.size();
-        
-        oss << "thumbnail_request_duration_microseconds{quantile=\"0.5\"} " << std::fixed << std::setprecision(2) << p50 << "\n";
-        oss << "thumbnail_request_duration_microseconds{quantile=\"0.95\"} " << std::fixed << std::setprecision(2) << p95 << "\n";
-        oss << "thumbnail_request_duration_microseconds{quantile=\"0.99\"} " << std::fixed << std::setprecision(2) << p99 << "\n";
-        oss << "thumbnail_request_duration_microseconds_sum " << std::fixed << std::setprecision(2) << sum << "\n";
-        oss << "thumbnail_request_duration_microseconds_count " << total_times_.size() << "\n\n";
+    // Per-stage breakdown; only label sets that have been seen
+    write_histogram_header(oss, "thumbnail_stage_duration_microseconds",
+                           "Time spent in each upload stage (read, parse, decode, resize, encode, write) in microseconds");
+    for (size_t stage = 0; stage < STAGES; ++stage) {
+        for (uint8_t in = 0; in < INPUT_FORMATS; ++in) {
+            for (uint8_t out = 0; out < OUTPUT_FORMATS; ++out) {
+                for (uint8_t size = 0; size < SIZE_CLASSES; ++size) {
+                    StageLabels labels{in, out, size};
+                    const LatencyHistogram* histogram =
+                        stage_times_[stage_index(static_cast<Stage>(stage), labels)].load(std::memory_order_acquire);
+                    if (!histogram) continue;
+                    std::string label_set = std::string("stage=\"") + STAGE_NAMES[stage] +
+                                            "\",input_format=\"" + INPUT_FORMAT_NAMES[in] +
+                                            "\",output_format=\"" + OUTPUT_FORMAT_NAMES[out] +
+                                            "\",size_class=\"" + SIZE_CLASS_NAMES[size] + "\",";
+                    write_histogram(oss, "thumbnail_stage_duration_microseconds", label_set, histogram->snapshot());
+                }
+            }
+        }
     }
+    oss << "\n";
     
-    if (!processing_times_.empty()) {
-        oss << "# HELP thumbnail_processing_duration_microseconds Image processing duration in microseconds\n";
-        oss << "# TYPE thumbnail_processing_duration_microseconds histogram\n";
-        
-        double p50 = calculate_percentile(processing_times_, 0.5);
-        double p95 = calculate_percentile(processing_times_, 0.95);
-        double p99 = calculate_percentile(processing_times_, 0.99);
-        
-        double sum = std::accumulate(processing_times_.begin(), processing_times_.end(), 0.0);
-        double mean = sum / processing_times_.size();
-        
-        oss << "thumbnail_processing_duration_microseconds{quantile=\"0.5\"} " << std::fixed << std::setprecision(2) << p50 << "\n";
-        oss << "thumbnail_processing_duration_microseconds{quantile=\"0.95\"} " << std::fixed << std::setprecision(2) << p95 << "\n";
-        oss << "thumbnail_processing_duration_microseconds{quantile=\"0.99\"} " << std::fixed << std::setprecision(2) << p99 << "\n";
-        oss << "thumbnail_processing_duration_microseconds_sum " << std::fixed << std::setprecision(2) << sum << "\n";
-        oss << "thumbnail_processing_duration_microseconds_count " << processing_times_.size() << "\n\n";
+    oss << "# HELP thumbnail_input_bytes_total Upload bytes received for processing\n";
+    oss << "# TYPE thumbnail_input_bytes_total counter\n";
+    for (size_t in = 0; in < INPUT_FORMATS; ++in) {
+        for (size_t size = 0; size < SIZE_CLASSES; ++size) {
+            uint64_t bytes = input_bytes_[in * SIZE_CLASSES + size].load(std::memory_order_relaxed);
+            if (bytes == 0) continue;
+            oss << "thumbnail_input_bytes_total{input_format=\"" << INPUT_FORMAT_NAMES[in]
+                << "\",size_class=\"" << SIZE_CLASS_NAMES[size] << "\"} " << bytes << "\n";
+        }
+    }
+    oss << "\n";
+    
+    oss << "# HELP thumbnail_output_bytes_total Thumbnail bytes sent for processed uploads\n";
+    oss << "# TYPE thumbnail_output_bytes_total counter\n";
+    for (size_t out = 0; out < OUTPUT_FORMATS; ++out) {
+        for (size_t size = 0; size < SIZE_CLASSES; ++size) {
+            uint64_t bytes = output_bytes_[out * SIZE_CLASSES + size].load(std::memory_order_relaxed);
+            if (bytes == 0) continue;
+            oss << "thumbnail_output_bytes_total{output_format=\"" << OUTPUT_FORMAT_NAMES[out]
+                << "\",size_class=\"" << SIZE_CLASS_NAMES[size] << "\"} " << bytes << "\n";
+        }
     }
+    oss << "\n";
     
     // Current performance status
-    if (!total_times_.empty()) {
-        double p99_ms = calculate_percentile(total_times_, 0.99) / 1000.0;
+    if (total.count > 0) {
+        double p99_ms = total.quantile(0.99) / 1000.0;
         oss << "# HELP thumbnail_performance_status Current performance status (1 = meeting <50ms goal)\n";
         oss << "# TYPE thumbnail_performance_status gauge\n";
         oss << "thumbnail_performance_status " << (p99_ms < 50.0 ? 1.0 : 0.0) << "\n\n";
         
-        oss << "# HELP thumbnail_p99_latency_ms 99th percentile latency in milliseconds\n";
+        oss << "# HELP thumbnail_p99_latency_ms 99th percentile latency in milliseconds since start, estimated from the histogram\n";
         oss << "# TYPE thumbnail_p99_latency_ms gauge\n";
         oss << "thumbnail_p99_latency_ms " << std::fixed << std::setprecision(2) << p99_ms << "\n";
     }
     
     return oss.str();
-} 
\ No newline at end of file
+}
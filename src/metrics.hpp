@@ -1,18 +1,96 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <mutex>
-#include <vector>
+#include "histogram.hpp"
+
+// Point-in-time counters from a result cache tier
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+    uint64_t capacity_bytes = 0;
+};
+
+// Pipeline stages timed for each upload
+enum class Stage { read, parse, decode, resize, encode, write };
+
+// Where a successful request's thumbnail came from
+enum class ResultSource {
+    processed,    // decoded and encoded for this request
+    memory_cache, // the in-memory result cache
+    disk_cache,   // the disk tier
+    coalesced     // shared from an identical job another request led
+};
+
+// Why a request failed
+enum class FailureClass {
+    bad_request,        // invalid query parameters
+    bad_multipart,      // malformed multipart body or no file part
+    unsupported_format, // not an image libvips can load
+    too_large,          // body over the size limit
+    decode,             // libvips could not decode (or encode) the image
+    timeout,            // client too slow sending the body
+    shed                // rejected with 503 because the server was saturated
+};
+
+// Label values for an upload's stage timings and byte counters, held as
+// small indices so they are cheap to carry along and record
+struct StageLabels {
+    uint8_t input_format = 0;
+    uint8_t output_format = 0;
+    uint8_t size_class = 0;
+};
 
 class MetricsCollector {
 public:
     MetricsCollector();
+    ~MetricsCollector();
+    
+    // Labels for an upload. Unrecognised input formats are reported as
+    // "other", and a batch (output_format "mixed") as one output. The size
+    // class comes from the input bytes: small up to 256 KiB, medium up to
+    // 2 MiB, large up to 8 MiB, xlarge beyond.
+    static StageLabels stage_labels(std::string_view input_format, std::string_view output_format,
+                                    uint64_t input_bytes);
+
+    // Record the time one pipeline stage took for an upload
+    void record_stage(Stage stage, const StageLabels& labels, int64_t microseconds);
+
+    // Count the bytes an upload brought in and the thumbnail bytes sent back
+    void record_bytes(const StageLabels& labels, uint64_t input_bytes, uint64_t output_bytes);
     
-    // Record a request with timing information
-    void record_request(int64_t total_microseconds, int64_t processing_microseconds);
+    // Record a successful request, timed from when its header arrived. Only
+    // processed requests feed the processing-time histogram; the rest are
+    // counted by source so cache hits can't dilute it.
+    void record_request(ResultSource source, int64_t total_microseconds, int64_t processing_microseconds = 0);
     
+    // Record a failed request, how it failed and how long it took to fail
+    void record_failure(FailureClass failure, int64_t total_microseconds);
+
+    // Time one disk tier lookup, apart from processing since a hit skips it
+    void record_disk_lookup(bool hit, int64_t microseconds);
+
+    // Count a request answered by joining an identical job already running
+    void record_coalesced();
+
+    // Snapshot of current load, refreshed before each scrape
+    void update_load(size_t queue_depth, size_t in_flight_uploads, uint64_t in_flight_bytes);
+
+    // Snapshot of the in-memory result cache, refreshed before each scrape
+    void update_cache(const CacheStats& stats);
+
+    // Same for the disk tier, when there is one
+    void update_disk_cache(const CacheStats& stats);
+
     // Get metrics in Prometheus text format
     std::string get_prometheus_metrics() const;
 
@@ -21,16 +99,44 @@ private:
     std::atomic<int64_t> total_requests_{0};
     std::atomic<int64_t> successful_requests_{0};
     std::atomic<int64_t> failed_requests_{0};
+    std::atomic<int64_t> shed_requests_{0};
+    std::atomic<int64_t> coalesced_requests_{0};
+
+    // Load gauges
+    std::atomic<int64_t> queue_depth_{0};
+    std::atomic<int64_t> in_flight_uploads_{0};
+    std::atomic<int64_t> in_flight_bytes_{0};
+
+    // Result cache, copied in from ResultCache::stats()
+    mutable std::mutex cache_mutex_;
+    CacheStats memory_cache_;
+    std::optional<CacheStats> disk_cache_;
     
-    // Timing statistics (using mutex for thread safety)
-    mutable std::mutex timing_mutex_;
-    std::vector<int64_t> total_times_;
-    std::vector<int64_t> processing_times_;
-    
-    // Keep only the last 1000 measurements to avoid memory bloat
-    static constexpr size_t MAX_SAMPLES = 1000;
-    
-    // Helper methods
-    void add_timing_sample(std::vector<int64_t>& samples, int64_t value);
-    double calculate_percentile(const std::vector<int64_t>& samples, double percentile) const;
-}; 
\ No newline at end of file
+    // Latency histograms in microseconds
+    LatencyHistogram total_times_;
+    LatencyHistogram processing_times_;
+    LatencyHistogram disk_hit_times_;
+    LatencyHistogram disk_miss_times_;
+
+    // Failures by class, and how long they took, kept apart from the
+    // successes so a fast error can't hide a slow one
+    static constexpr size_t FAILURE_CLASSES = 7;
+    std::array<std::atomic<int64_t>, FAILURE_CLASSES> failures_{};
+    std::array<LatencyHistogram, FAILURE_CLASSES> failed_times_;
+
+    // Successful requests by ResultSource
+    static constexpr size_t RESULT_SOURCES = 4;
+    std::array<std::atomic<int64_t>, RESULT_SOURCES> served_{};
+
+    static constexpr size_t STAGES = 6;
+    static constexpr size_t INPUT_FORMATS = 9;
+    static constexpr size_t OUTPUT_FORMATS = 6;
+    static constexpr size_t SIZE_CLASSES = 4;
+
+    static size_t stage_index(Stage stage, const StageLabels& labels);
+
+    // Per stage and label set, created on first use since most combinations never occur
+    std::array<std::atomic<LatencyHistogram*>, STAGES * INPUT_FORMATS * OUTPUT_FORMATS * SIZE_CLASSES> stage_times_{};
+    std::array<std::atomic<uint64_t>, INPUT_FORMATS * SIZE_CLASSES> input_bytes_{};
+    std::array<std::atomic<uint64_t>, OUTPUT_FORMATS * SIZE_CLASSES> output_bytes_{};
+};
\ No newline at end of file
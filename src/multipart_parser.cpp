@@ -0,0 +1,267 @@
+#include "multipart_parser.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+        if (y >= 'A' && y <= 'Z') y = static_cast<char>(y - 'A' + 'a');
+        if (x != y) return false;
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Find a `key=value` or `key="quoted value"` parameter in a header value
+// such as `form-data; name="file"; filename="a.jpg"`
+std::optional<std::string> find_param(std::string_view value, std::string_view key) {
+    size_t pos = value.find(';');
+    while (pos != std::string_view::npos) {
+        ++pos;
+        size_t eq = value.find('=', pos);
+        if (eq == std::string_view::npos) return std::nullopt;
+        std::string_view name = trim(value.substr(pos, eq - pos));
+
+        std::string param;
+        size_t i = eq + 1;
+        while (i < value.size() && (value[i] == ' ' || value[i] == '\t')) ++i;
+        if (i < value.size() && value[i] == '"') {
+            for (++i; i < value.size() && value[i] != '"'; ++i) {
+                if (value[i] == '\\' && i + 1 < value.size()) ++i;
+                param += value[i];
+            }
+            pos = value.find(';', i);
+        } else {
+            size_t end = value.find(';', i);
+            param = std::string(trim(value.substr(i, end == std::string_view::npos ? std::string_view::npos : end - i)));
+            pos = end;
+        }
+
+        if (iequals(name, key)) return param;
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+MultipartParser::MultipartParser(std::string boundary)
+    : delimiter_("\r\n--" + boundary) {
+    const size_t m = delimiter_.size();
+    skip_.fill(m);
+    for (size_t j = 0; j + 1 < m; ++j) {
+        skip_[static_cast<unsigned char>(delimiter_[j])] = m - 1 - j;
+    }
+    // The body normally opens with "--boundary" and no leading CRLF;
+    // priming the carry lets the ordinary delimiter search match it
+    carry_ = "\r\n";
+}
+
+std::optional<std::string> MultipartParser::parse_boundary(std::string_view content_type) {
+    auto boundary = find_param(content_type, "boundary");
+    // RFC 2046: 1 to 70 characters
+    if (!boundary || boundary->empty() || boundary->size() > 70) {
+        return std::nullopt;
+    }
+    return boundary;
+}
+
+bool MultipartParser::feed(const char* data, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
+        switch (state_) {
+        case State::preamble:
+        case State::body: {
+            ScanResult result = scan_body(data + pos, size - pos);
+            pos += result.consumed;
+            if (result.found_delimiter) {
+                if (in_file_part_) {
+                    in_file_part_ = false;
+                    file_found_ = true;
+                }
+                after_boundary_.clear();
+                state_ = State::after_boundary;
+            }
+            break;
+        }
+        case State::after_boundary: {
+            // "--" ends the body; otherwise optional padding then CRLF starts a part
+            char c = data[pos++];
+            if (after_boundary_.empty() && c == '-') {
+                after_boundary_ = "-";
+            } else if (after_boundary_ == "-") {
+                if (c != '-') {
+                    fail(Error::malformed);
+                    return false;
+                }
+                state_ = State::epilogue;
+            } else if (after_boundary_.empty() && (c == ' ' || c == '\t')) {
+                // transport padding
+            } else if (after_boundary_.empty() && c == '\r') {
+                after_boundary_ = "\r";
+            } else if (after_boundary_ == "\r" && c == '\n') {
+                header_block_.clear();
+                state_ = State::headers;
+            } else {
+                fail(Error::malformed);
+                return false;
+            }
+            break;
+        }
+        case State::headers: {
+            // Part headers are short, so a byte at a time is fine here
+            while (pos < size) {
+                header_block_ += data[pos++];
+                bool done = header_block_ == "\r\n" ||
+                            (header_block_.size() >= 4 &&
+                             header_block_.compare(header_block_.size() - 4, 4, "\r\n\r\n") == 0);
+                if (done) {
+                    if (!parse_part_headers()) return false;
+                    carry_.clear();
+                    state_ = State::body;
+                    break;
+                }
+                if (header_block_.size() > MAX_HEADER_BYTES) {
+                    fail(Error::headers_too_large);
+                    return false;
+                }
+            }
+            break;
+        }
+        case State::epilogue:
+            return true; // anything after the closing boundary is ignored
+        case State::failed:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MultipartParser::finish() {
+    if (state_ == State::failed) return false;
+    if (state_ != State::epilogue) {
+        fail(Error::malformed);
+        return false;
+    }
+    if (!file_found_) {
+        fail(Error::no_file_part);
+        return false;
+    }
+    return true;
+}
+
+MultipartParser::ScanResult MultipartParser::scan_body(const char* data, size_t size) {
+    const size_t m = delimiter_.size();
+
+    // Settle a delimiter prefix carried over from the previous chunk
+    while (!carry_.empty()) {
+        size_t need = m - carry_.size();
+        size_t take = std::min(need, size);
+        if (std::memcmp(data, delimiter_.data() + carry_.size(), take) == 0) {
+            if (take == need) {
+                carry_.clear();
+                return {need, true};
+            }
+            carry_.append(data, take);
+            return {take, false};
+        }
+        // Not a delimiter after all. Release bytes up to the next position
+        // inside the carry where a delimiter could still start.
+        size_t k = 1;
+        while (k < carry_.size() &&
+               std::memcmp(carry_.data() + k, delimiter_.data(), carry_.size() - k) != 0) {
+            ++k;
+        }
+        emit(carry_.data(), k);
+        carry_.erase(0, k);
+    }
+
+    size_t found = find_delimiter(data, size);
+    if (found != std::string::npos) {
+        emit(data, found);
+        return {found + m, true};
+    }
+
+    // Hold back the longest tail that could begin a delimiter
+    size_t keep = std::min(m - 1, size);
+    while (keep > 0 && std::memcmp(data + size - keep, delimiter_.data(), keep) != 0) {
+        --keep;
+    }
+    emit(data, size - keep);
+    carry_.assign(data + size - keep, keep);
+    return {size, false};
+}
+
+size_t MultipartParser::find_delimiter(const char* data, size_t size) const {
+    const size_t m = delimiter_.size();
+    if (size < m) return std::string::npos;
+
+    const char last = delimiter_[m - 1];
+    size_t i = 0;
+    while (i <= size - m) {
+        unsigned char c = static_cast<unsigned char>(data[i + m - 1]);
+        if (c == static_cast<unsigned char>(last) &&
+            std::memcmp(data + i, delimiter_.data(), m - 1) == 0) {
+            return i;
+        }
+        i += skip_[c];
+    }
+    return std::string::npos;
+}
+
+void MultipartParser::emit(const char* data, size_t size) {
+    if (in_file_part_ && size > 0) {
+        file_.insert(file_.end(),
+                     reinterpret_cast<const uint8_t*>(data),
+                     reinterpret_cast<const uint8_t*>(data) + size);
+    }
+}
+
+bool MultipartParser::parse_part_headers() {
+    std::string_view block(header_block_);
+    std::optional<std::string> name;
+    std::optional<std::string> filename;
+    std::string content_type;
+
+    while (!block.empty()) {
+        size_t eol = block.find("\r\n");
+        std::string_view line = block.substr(0, eol);
+        block.remove_prefix(eol == std::string_view::npos ? block.size() : eol + 2);
+        if (line.empty()) continue;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            fail(Error::malformed);
+            return false;
+        }
+        std::string_view field = trim(line.substr(0, colon));
+        std::string_view value = trim(line.substr(colon + 1));
+        if (iequals(field, "Content-Disposition")) {
+            name = find_param(value, "name");
+            filename = find_param(value, "filename");
+        } else if (iequals(field, "Content-Type")) {
+            content_type = std::string(value);
+        }
+    }
+
+    in_file_part_ = !file_found_ && (filename || (name && *name == "file"));
+    if (in_file_part_) {
+        file_name_ = filename.value_or("");
+        file_content_type_ = content_type;
+    }
+    return true;
+}
+
+void MultipartParser::fail(Error error) {
+    error_ = error;
+    state_ = State::failed;
+    in_file_part_ = false;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Incremental multipart/form-data parser. Bytes are fed in whatever chunks
+// the socket delivers; the first file part is appended to file() as it
+// streams past and every other part is skipped, so the body is never held
+// in memory as a whole.
+class MultipartParser {
+public:
+    enum class Error {
+        none,
+        malformed,        // bad part headers or missing final boundary
+        headers_too_large,
+        no_file_part
+    };
+
+    explicit MultipartParser(std::string boundary);
+
+    // Extract the boundary parameter from a multipart Content-Type value
+    static std::optional<std::string> parse_boundary(std::string_view content_type);
+
+    // Consume the next chunk of the body. Returns false once the body is
+    // known to be malformed; further input is ignored.
+    bool feed(const char* data, size_t size);
+
+    // Call after the last chunk; checks that the closing boundary was seen
+    // and a file part was found
+    bool finish();
+
+    // Contents of the first part that carries a filename (or is named "file")
+    std::vector<uint8_t>& file() { return file_; }
+    const std::vector<uint8_t>& file() const { return file_; }
+
+    Error error() const { return error_; }
+    bool file_found() const { return file_found_; }
+    const std::string& file_name() const { return file_name_; }
+    const std::string& file_content_type() const { return file_content_type_; }
+
+private:
+    enum class State {
+        preamble,       // before the first boundary
+        after_boundary, // expecting CRLF (next part) or "--" (end)
+        headers,
+        body,
+        epilogue,
+        failed
+    };
+
+    struct ScanResult {
+        size_t consumed;
+        bool found_delimiter;
+    };
+
+    // Pass body bytes up to the next delimiter to emit(), withholding any
+    // tail that could be the start of a delimiter split across chunks
+    ScanResult scan_body(const char* data, size_t size);
+    size_t find_delimiter(const char* data, size_t size) const;
+    void emit(const char* data, size_t size);
+    bool parse_part_headers();
+    void fail(Error error);
+
+    static constexpr size_t MAX_HEADER_BYTES = 8 * 1024;
+
+    std::string delimiter_;                 // "\r\n--" + boundary
+    std::array<size_t, 256> skip_{};        // Boyer-Moore-Horspool shift table
+    std::vector<uint8_t> file_;
+
+    State state_ = State::preamble;
+    Error error_ = Error::none;
+    std::string carry_;                     // partial delimiter from the last chunk
+    std::string header_block_;
+    std::string after_boundary_;
+    bool in_file_part_ = false;
+    bool file_found_ = false;
+    std::string file_name_;
+    std::string file_content_type_;
+};
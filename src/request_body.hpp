@@ -0,0 +1,123 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/optional.hpp>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "hash.hpp"
+#include "multipart_parser.hpp"
+
+// Beast body for incoming requests. Bytes are buffered as they arrive,
+// unless the server has switched the body to multipart mode from the
+// request header, in which case each chunk goes straight through a
+// MultipartParser and only the uploaded file is kept. The kept bytes are
+// hashed as they arrive to give the upload a content fingerprint, and the
+// time spent waiting on the network and parsing is kept apart.
+struct request_body {
+    class value_type {
+    public:
+        // Must be called before the body is read
+        void expect_multipart(std::string boundary) {
+            multipart_.emplace(std::move(boundary));
+        }
+
+        // The raw body, or just the file part of a multipart body
+        const std::vector<uint8_t>& data() const { return multipart_ ? multipart_->file() : data_; }
+
+        // XXH64 of data(), computed while the body was read
+        uint64_t content_hash() const { return hasher_.digest(); }
+
+        // Null unless the body was parsed as multipart
+        const MultipartParser* multipart() const { return multipart_ ? &*multipart_ : nullptr; }
+
+        // Time from the start of the body to its end not spent parsing,
+        // i.e. mostly waiting on the client
+        int64_t read_microseconds() const { return to_micros(read_time_ - parse_time_); }
+        // Time spent unpacking a multipart body (zero for raw bodies)
+        int64_t parse_microseconds() const { return to_micros(parse_time_); }
+
+    private:
+        friend struct request_body;
+
+        std::vector<uint8_t>& target() { return multipart_ ? multipart_->file() : data_; }
+
+        static int64_t to_micros(std::chrono::steady_clock::duration d) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        }
+
+        std::vector<uint8_t> data_;
+        std::optional<MultipartParser> multipart_;
+        Hasher hasher_;
+        std::chrono::steady_clock::time_point read_start_;
+        std::chrono::steady_clock::duration read_time_{};
+        std::chrono::steady_clock::duration parse_time_{};
+    };
+
+    static std::uint64_t size(const value_type& body) {
+        return body.data().size();
+    }
+
+    class reader {
+    public:
+        template <bool isRequest, class Fields>
+        reader(boost::beast::http::header<isRequest, Fields>&, value_type& body)
+            : body_(body) {
+        }
+
+        void init(const boost::optional<std::uint64_t>& content_length, boost::beast::error_code& ec) {
+            // A file part is never larger than the body that carries it, so
+            // one reservation avoids regrowing (and recopying) large uploads
+            if (content_length) {
+                body_.target().reserve(static_cast<size_t>(*content_length));
+            }
+            body_.read_start_ = std::chrono::steady_clock::now();
+            ec = {};
+        }
+
+        template <class ConstBufferSequence>
+        std::size_t put(const ConstBufferSequence& buffers, boost::beast::error_code& ec) {
+            std::size_t consumed = 0;
+            size_t kept_before = body_.target().size();
+            auto parse_start = body_.multipart_ ? std::chrono::steady_clock::now()
+                                                : std::chrono::steady_clock::time_point();
+            for (auto it = boost::asio::buffer_sequence_begin(buffers);
+                 it != boost::asio::buffer_sequence_end(buffers); ++it) {
+                boost::asio::const_buffer buffer = *it;
+                const char* data = static_cast<const char*>(buffer.data());
+                if (body_.multipart_) {
+                    // A malformed body is still drained so the handler can answer 400
+                    body_.multipart_->feed(data, buffer.size());
+                } else {
+                    body_.data_.insert(body_.data_.end(),
+                                       reinterpret_cast<const uint8_t*>(data),
+                                       reinterpret_cast<const uint8_t*>(data) + buffer.size());
+                }
+                consumed += buffer.size();
+            }
+            if (body_.multipart_) {
+                body_.parse_time_ += std::chrono::steady_clock::now() - parse_start;
+            }
+            // Fingerprint only what was kept, while it is still in cache
+            const auto& kept = body_.target();
+            body_.hasher_.update(kept.data() + kept_before, kept.size() - kept_before);
+            ec = {};
+            return consumed;
+        }
+
+        void finish(boost::beast::error_code& ec) {
+            if (body_.multipart_) {
+                body_.multipart_->finish();
+            }
+            body_.read_time_ = std::chrono::steady_clock::now() - body_.read_start_;
+            ec = {};
+        }
+
+    private:
+        value_type& body_;
+    };
+};
@@ -0,0 +1,91 @@
+#include "result_cache.hpp"
+#include <cstdio>
+#include "hash.hpp"
+
+uint64_t ThumbnailKey::digest() const {
+    uint64_t params_hash = Hasher::hash(params.data(), params.size(), content_size);
+    return content_hash ^ (params_hash + 0x9E3779B97F4A7C15ULL + (content_hash << 6) + (content_hash >> 2));
+}
+
+std::string ThumbnailKey::etag() const {
+    char tag[40];
+    std::snprintf(tag, sizeof(tag), "\"%016llx%016llx\"",
+                  static_cast<unsigned long long>(content_hash),
+                  static_cast<unsigned long long>(Hasher::hash(params.data(), params.size(), content_size)));
+    return tag;
+}
+
+ResultCache::ResultCache(size_t max_bytes)
+    : max_bytes_(max_bytes), shard_budget_(max_bytes / SHARD_COUNT) {
+}
+
+ResultCache::Shard& ResultCache::shard_for(const ThumbnailKey& key) {
+    // The low bits feed the hash table buckets, so pick the shard from the high bits
+    return shards_[(key.digest() >> 59) % SHARD_COUNT];
+}
+
+size_t ResultCache::entry_bytes(const Entry& entry) {
+    // Count the key and bookkeeping too so tiny thumbnails can't blow the budget
+    return entry.value->size() + entry.key.params.size() + sizeof(Entry) + 64;
+}
+
+std::shared_ptr<const SharedBuffer> ResultCache::get(const ThumbnailKey& key) {
+    if (!enabled()) return nullptr;
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return it->second->value;
+}
+
+void ResultCache::put(const ThumbnailKey& key, std::shared_ptr<const SharedBuffer> value) {
+    if (!enabled() || !value) return;
+
+    Entry entry{key, std::move(value)};
+    size_t size = entry_bytes(entry);
+    if (size > shard_budget_) return; // would evict the whole shard for one entry
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto existing = shard.index.find(key);
+    if (existing != shard.index.end()) {
+        // Identical output from a racing request; keep the one we have
+        shard.lru.splice(shard.lru.begin(), shard.lru, existing->second);
+        return;
+    }
+
+    while (shard.bytes + size > shard_budget_ && !shard.lru.empty()) {
+        const Entry& victim = shard.lru.back();
+        size_t victim_size = entry_bytes(victim);
+        shard.index.erase(victim.key);
+        shard.lru.pop_back();
+        shard.bytes -= victim_size;
+        bytes_.fetch_sub(victim_size, std::memory_order_relaxed);
+        entries_.fetch_sub(1, std::memory_order_relaxed);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.lru.push_front(std::move(entry));
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += size;
+    bytes_.fetch_add(size, std::memory_order_relaxed);
+    entries_.fetch_add(1, std::memory_order_relaxed);
+}
+
+CacheStats ResultCache::stats() const {
+    CacheStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    stats.entries = entries_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.capacity_bytes = max_bytes_;
+    return stats;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "metrics.hpp"
+#include "shared_buffer.hpp"
+
+// Identifies one thumbnail: the input's fingerprint plus every parameter
+// that affects the output bytes
+struct ThumbnailKey {
+    uint64_t content_hash = 0;
+    uint64_t content_size = 0;
+    std::string params;
+
+    bool operator==(const ThumbnailKey& other) const {
+        return content_hash == other.content_hash &&
+               content_size == other.content_size &&
+               params == other.params;
+    }
+
+    // Mixes the parameters into the content hash
+    uint64_t digest() const;
+
+    // Strong HTTP entity tag for the thumbnail this key produces
+    std::string etag() const;
+};
+
+// In-memory LRU of encoded thumbnails, bounded by total bytes. Split into
+// independently locked shards so concurrent lookups rarely contend.
+class ResultCache {
+public:
+    explicit ResultCache(size_t max_bytes);
+
+    // Null on a miss; a hit becomes the most recently used entry
+    std::shared_ptr<const SharedBuffer> get(const ThumbnailKey& key);
+
+    void put(const ThumbnailKey& key, std::shared_ptr<const SharedBuffer> value);
+
+    bool enabled() const { return max_bytes_ > 0; }
+    CacheStats stats() const;
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct KeyHash {
+        size_t operator()(const ThumbnailKey& key) const { return static_cast<size_t>(key.digest()); }
+    };
+
+    struct Entry {
+        ThumbnailKey key;
+        std::shared_ptr<const SharedBuffer> value;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru; // front = most recently used
+        std::unordered_map<ThumbnailKey, std::list<Entry>::iterator, KeyHash> index;
+        size_t bytes = 0;
+    };
+
+    Shard& shard_for(const ThumbnailKey& key);
+    static size_t entry_bytes(const Entry& entry);
+
+    size_t max_bytes_;
+    size_t shard_budget_;
+    std::array<Shard, SHARD_COUNT> shards_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> entries_{0};
+    std::atomic<uint64_t> bytes_{0};
+};
@@ -0,0 +1,109 @@
+#include "router.hpp"
+
+namespace {
+
+struct RouteEntry {
+    http::verb method;
+    const char* path;
+    Route route;
+};
+
+const RouteEntry ROUTES[] = {
+    {http::verb::post, "/upload", Route::upload},
+    {http::verb::post, "/upload/batch", Route::upload_batch},
+    {http::verb::put, "/thumbnail", Route::thumbnail},
+    {http::verb::get, "/thumb", Route::local_thumbnail},
+    {http::verb::get, "/metrics", Route::metrics},
+};
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+RequestTarget split_target(beast::string_view target) {
+    auto question = target.find('?');
+    if (question == beast::string_view::npos) {
+        return {target, {}};
+    }
+    return {target.substr(0, question), target.substr(question + 1)};
+}
+
+Route find_route(http::verb method, beast::string_view path) {
+    for (const auto& entry : ROUTES) {
+        if (entry.method == method && path == entry.path) {
+            return entry.route;
+        }
+    }
+    return method == http::verb::get ? Route::static_asset : Route::not_found;
+}
+
+QueryParams::Error QueryParams::parse(beast::string_view query) {
+    count_ = 0;
+    decoded_size_ = 0;
+    Error error = Error::none;
+    while (!query.empty()) {
+        auto amp = query.find('&');
+        beast::string_view piece = query.substr(0, amp);
+        query = amp == beast::string_view::npos ? beast::string_view{} : query.substr(amp + 1);
+
+        auto equals = piece.find('=');
+        if (equals == beast::string_view::npos || equals == 0) {
+            continue;
+        }
+        if (count_ == MAX_PARAMS) {
+            return Error::too_many;
+        }
+        auto key = decode(piece.substr(0, equals), error);
+        auto value = key ? decode(piece.substr(equals + 1), error) : std::nullopt;
+        if (!value) {
+            return error;
+        }
+        params_[count_++] = {*key, *value};
+    }
+    return Error::none;
+}
+
+std::optional<beast::string_view> QueryParams::get(beast::string_view key) const {
+    for (size_t i = count_; i-- > 0;) {
+        if (params_[i].key == key) {
+            return params_[i].value;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<beast::string_view> QueryParams::decode(beast::string_view text, Error& error) {
+    // Nearly every query is plain ASCII; leave those in place
+    if (text.find_first_of("%+") == beast::string_view::npos) {
+        return text;
+    }
+    if (text.size() > DECODE_BUFFER - decoded_size_) {
+        error = Error::too_long;
+        return std::nullopt;
+    }
+    char* out = decoded_.data() + decoded_size_;
+    size_t size = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '+') {
+            out[size++] = ' ';
+        } else if (text[i] == '%') {
+            int high = i + 2 < text.size() ? hex_value(text[i + 1]) : -1;
+            int low = high >= 0 ? hex_value(text[i + 2]) : -1;
+            if (low < 0) {
+                error = Error::bad_escape;
+                return std::nullopt;
+            }
+            out[size++] = static_cast<char>(high * 16 + low);
+            i += 2;
+        } else {
+            out[size++] = text[i];
+        }
+    }
+    decoded_size_ += size;
+    return beast::string_view(out, size);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <array>
+#include <cstddef>
+#include <optional>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+enum class Route {
+    upload,          // POST /upload, multipart
+    upload_batch,    // POST /upload/batch, multipart
+    thumbnail,       // PUT /thumbnail, raw image body
+    local_thumbnail, // GET /thumb?path=, from the configured local root
+    metrics,         // GET /metrics
+    static_asset,    // any other GET
+    not_found,
+};
+
+// A request target split at the '?', as views into it
+struct RequestTarget {
+    beast::string_view path;
+    beast::string_view query; // empty without a '?'
+};
+
+RequestTarget split_target(beast::string_view target);
+
+// Exact method and path match against a fixed table. No allocation, so it
+// can run on the header before the body is read.
+Route find_route(http::verb method, beast::string_view path);
+
+// Query parameters of one request. Keys and values are views into the
+// target, or into an inline buffer for the ones that needed percent- or
+// '+'-decoding, so parsing never touches the heap. Not copyable: the views
+// may point into the object itself.
+class QueryParams {
+public:
+    enum class Error { none, too_many, too_long, bad_escape };
+
+    QueryParams() = default;
+    QueryParams(const QueryParams&) = delete;
+    QueryParams& operator=(const QueryParams&) = delete;
+
+    // "a=1&b=x%20y". Pieces without '=' are ignored. The query must outlive
+    // this object.
+    Error parse(beast::string_view query);
+
+    // The last value given for a key, as a repeated key overrides
+    std::optional<beast::string_view> get(beast::string_view key) const;
+    bool has(beast::string_view key) const { return get(key).has_value(); }
+    size_t size() const { return count_; }
+
+private:
+    static constexpr size_t MAX_PARAMS = 32;
+    // Beast caps the whole header at 8 KiB, but no valid query comes close
+    static constexpr size_t DECODE_BUFFER = 2048;
+
+    struct Param {
+        beast::string_view key;
+        beast::string_view value;
+    };
+
+    // Decodes into the buffer if needed; nullopt on a bad escape or a full buffer
+    std::optional<beast::string_view> decode(beast::string_view text, Error& error);
+
+    std::array<Param, MAX_PARAMS> params_;
+    size_t count_ = 0;
+    std::array<char, DECODE_BUFFER> decoded_;
+    size_t decoded_size_ = 0;
+};
@@ -1,13 +1,414 @@
 #include "server.hpp"
-#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 #include <chrono>
 #include <boost/algorithm/string.hpp>
-#include <regex>
+#include <random>
+#include <system_error>
+#include <ctime>
+#include "logger.hpp"
 
-ThumbnailServer::ThumbnailServer(int port, int thread_count)
-    : port_(port), thread_count_(thread_count), ioc_(thread_count) {
+namespace {
+
+enum class UploadKind { none, multipart, raw };
+
+// POST /upload takes multipart/form-data; PUT /thumbnail takes the image
+// bytes as the whole body
+UploadKind upload_kind(Route route) {
+    switch (route) {
+    case Route::upload:
+    case Route::upload_batch:
+        return UploadKind::multipart;
+    case Route::thumbnail:
+        return UploadKind::raw;
+    default:
+        return UploadKind::none;
+    }
+}
+
+// Most sizes one batch request may ask for
+constexpr size_t MAX_BATCH_SIZES = 8;
+
+std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    boost::split(items, list, boost::is_any_of(","));
+    items.erase(std::remove(items.begin(), items.end(), ""), items.end());
+    return items;
+}
+
+// "64,128,large" -> {64, 128, 256}; empty on any invalid entry
+std::vector<int> parse_batch_sizes(const std::string& list, int max_edge) {
+    std::vector<int> sizes;
+    for (const auto& item : split_list(list)) {
+        int size = 0;
+        if (item == "small") size = 64;
+        else if (item == "medium") size = 128;
+        else if (item == "large") size = 256;
+        else if (item.find_first_not_of("0123456789") == std::string::npos && item.size() <= 4) size = std::stoi(item);
+        if (size < 1 || size > max_edge) return {};
+        if (std::find(sizes.begin(), sizes.end(), size) == sizes.end()) sizes.push_back(size);
+    }
+    if (sizes.size() > MAX_BATCH_SIZES) return {};
+    return sizes;
+}
+
+std::vector<std::string> parse_batch_formats(const std::string& list, const std::vector<std::string>& supported) {
+    std::vector<std::string> formats;
+    for (const auto& item : split_list(list)) {
+        if (std::find(supported.begin(), supported.end(), item) == supported.end()) return {};
+        if (std::find(formats.begin(), formats.end(), item) == formats.end()) formats.push_back(item);
+    }
+    return formats;
+}
+
+bool has_file_part(const Request& req) {
+    const MultipartParser* multipart = req.body().multipart();
+    return multipart && multipart->error() == MultipartParser::Error::none && !req.body().data().empty();
+}
+
+// Shared by the decode job and the encode jobs of one batch request; the
+// last encode to finish assembles the response
+struct BatchState {
+    std::vector<std::string> formats;
+    EncodeOptions encode;
+    std::vector<PyramidLevel> levels;
+    std::vector<std::shared_ptr<const SharedBuffer>> outputs; // level-major
+    StageLabels labels;                       // output_format "mixed", for whole-batch stages
+    std::vector<StageLabels> format_labels;   // per format, for the encodes
+    uint64_t input_bytes = 0;
+    std::atomic<size_t> remaining{0};
+    std::atomic<bool> failed{false};
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point process_start;
+};
+
+std::string random_boundary() {
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    char boundary[48];
+    std::snprintf(boundary, sizeof(boundary), "thumbnailgen-%016llx%016llx",
+                  static_cast<unsigned long long>(rng()), static_cast<unsigned long long>(rng()));
+    return boundary;
+}
+
+constexpr std::pair<const char*, Fit> FIT_NAMES[] = {
+    {"cover", Fit::cover}, {"contain", Fit::contain}, {"fill", Fit::fill}, {"inside", Fit::inside},
+};
+
+constexpr std::pair<const char*, Gravity> GRAVITY_NAMES[] = {
+    {"centre", Gravity::centre}, {"center", Gravity::centre},
+    {"north", Gravity::north}, {"south", Gravity::south},
+    {"east", Gravity::east}, {"west", Gravity::west},
+    {"northeast", Gravity::north_east}, {"northwest", Gravity::north_west},
+    {"southeast", Gravity::south_east}, {"southwest", Gravity::south_west},
+    {"entropy", Gravity::entropy}, {"attention", Gravity::attention},
+};
+
+template <class T, size_t N>
+std::optional<T> lookup(const std::pair<const char*, T> (&names)[N], beast::string_view name) {
+    for (const auto& [key, value] : names) {
+        if (name == key) return value;
+    }
+    return std::nullopt;
+}
+
+template <class T, size_t N>
+const char* name_of(const std::pair<const char*, T> (&names)[N], T value) {
+    for (const auto& [key, v] : names) {
+        if (v == value) return key;
+    }
+    return "";
+}
+
+std::optional<int> parse_edge(beast::string_view value) {
+    if (value.empty() || value.size() > 5) {
+        return std::nullopt;
+    }
+    int parsed = 0;
+    for (char c : value) {
+        if (c < '0' || c > '9') return std::nullopt;
+        parsed = parsed * 10 + (c - '0');
+    }
+    return parsed;
+}
+
+constexpr std::pair<const char*, EncodeOptions::Subsample> SUBSAMPLE_NAMES[] = {
+    {"auto", EncodeOptions::Subsample::automatic},
+    {"on", EncodeOptions::Subsample::on},
+    {"off", EncodeOptions::Subsample::off},
+};
+
+std::optional<bool> parse_flag(beast::string_view value) {
+    if (value == "1" || value == "true") return true;
+    if (value == "0" || value == "false") return false;
+    return std::nullopt;
+}
+
+// Fill in encoder settings over the server defaults already in `options`
+std::optional<std::string> parse_encode_options(const QueryParams& params,
+                                                const ServerConfig& config,
+                                                const std::string& format,
+                                                EncodeOptions& options) {
+    auto param = [&](const char* key) { return params.get(key); };
+    auto integer = [&](const char* key, int min, int max, int& out) -> std::optional<std::string> {
+        if (auto value = param(key)) {
+            auto parsed = parse_edge(*value);
+            if (!parsed || *parsed < min || *parsed > max) {
+                return std::string(key) + " must be between " + std::to_string(min) + " and " + std::to_string(max);
+            }
+            out = *parsed;
+        }
+        return std::nullopt;
+    };
+    auto flag = [&](const char* key, bool& out) -> std::optional<std::string> {
+        if (auto value = param(key)) {
+            auto parsed = parse_flag(*value);
+            if (!parsed) return std::string(key) + " must be true or false";
+            out = *parsed;
+        }
+        return std::nullopt;
+    };
+
+    if (auto error = integer(params.has("quality") ? "quality" : "q", 1, 100, options.quality)) return error;
+    if (auto error = integer("webp_effort", 0, config.max_webp_effort, options.webp_effort)) return error;
+    if (auto error = integer("avif_effort", 0, config.max_avif_effort, options.avif_effort)) return error;
+    if (auto error = integer("jxl_effort", 1, config.max_jxl_effort, options.jxl_effort)) return error;
+    if (auto error = integer("compression", 0, config.max_png_compression, options.png_compression)) return error;
+    // effort is shorthand for the output format's own setting
+    if (format == "webp") {
+        if (auto error = integer("effort", 0, config.max_webp_effort, options.webp_effort)) return error;
+    } else if (format == "avif") {
+        if (auto error = integer("effort", 0, config.max_avif_effort, options.avif_effort)) return error;
+    } else if (format == "jxl") {
+        if (auto error = integer("effort", 1, config.max_jxl_effort, options.jxl_effort)) return error;
+    }
+    if (auto error = flag("lossless", options.lossless)) return error;
+    if (auto error = flag("progressive", options.jpeg_progressive)) return error;
+    if (auto error = flag("optimize", options.jpeg_optimize_coding)) return error;
+    if (auto error = flag("palette", options.png_palette)) return error;
+    if (auto subsample = param("subsample")) {
+        auto parsed = lookup(SUBSAMPLE_NAMES, *subsample);
+        if (!parsed) return "subsample must be auto, on or off";
+        options.jpeg_subsample = *parsed;
+    }
+    if (options.lossless && !config.allow_lossless) {
+        return "lossless output is disabled on this server";
+    }
+    return std::nullopt;
+}
+
+// Build thumbnail options from query parameters. `size` is the original
+// shorthand for a square; w/h override it. Returns an error message for
+// anything malformed or beyond the configured output limits.
+std::optional<std::string> parse_thumbnail_options(const QueryParams& params,
+                                                   const ServerConfig& config,
+                                                   const std::vector<std::string>& formats,
+                                                   ThumbnailOptions& options) {
+    auto param = [&](const char* key) { return params.get(key); };
+
+    if (auto format = param("format")) {
+        // Unknown formats have always fallen back to PNG; known ones this
+        // libvips build can't encode are refused
+        bool known = *format == "jpeg" || *format == "webp" || *format == "avif" || *format == "jxl";
+        options.format = known ? std::string(*format) : "png";
+        if (std::find(formats.begin(), formats.end(), options.format) == formats.end()) {
+            return "format=" + options.format + " is not available on this server";
+        }
+    }
+    if (auto size = param("size")) {
+        if (*size == "small") options.width = options.height = 64;
+        else if (*size == "large") options.width = options.height = 256;
+        // else medium (default) is 128x128
+    }
+    if (param("w") || param("h")) {
+        // Giving only one edge scales the other to keep the aspect ratio
+        options.width = options.height = 0;
+        for (auto [key, edge] : {std::pair{"w", &options.width}, std::pair{"h", &options.height}}) {
+            if (auto value = param(key)) {
+                auto parsed = parse_edge(*value);
+                if (!parsed || *parsed < 1) return std::string(key) + " must be a positive integer";
+                *edge = *parsed;
+            }
+        }
+    }
+    if (auto fit = param("fit")) {
+        auto parsed = lookup(FIT_NAMES, *fit);
+        if (!parsed) return "fit must be cover, contain, fill or inside";
+        options.fit = *parsed;
+    }
+    if (options.width == 0 || options.height == 0) {
+        // The derived edge follows the image's aspect ratio, so bound it too
+        if (options.width == 0) options.width = config.max_output_edge;
+        if (options.height == 0) options.height = config.max_output_edge;
+        options.fit = Fit::inside;
+    }
+    if (options.width > config.max_output_edge || options.height > config.max_output_edge) {
+        return "w and h may be at most " + std::to_string(config.max_output_edge);
+    }
+    if (static_cast<uint64_t>(options.width) * options.height > config.max_output_pixels) {
+        return "w x h may be at most " + std::to_string(config.max_output_pixels) + " pixels";
+    }
+    if (auto gravity = param("gravity")) {
+        auto parsed = lookup(GRAVITY_NAMES, *gravity);
+        if (!parsed) return "gravity must be centre, a compass direction, entropy or attention";
+        if ((*parsed == Gravity::entropy || *parsed == Gravity::attention) && options.fit != Fit::cover) {
+            return "gravity=" + std::string(*gravity) + " only applies to fit=cover";
+        }
+        options.gravity = *parsed;
+    }
+    options.encode = config.encode_defaults;
+    return parse_encode_options(params, config, options.format, options.encode);
+}
+
+const char* content_type_for(const std::string& format) {
+    if (format == "jpeg") return "image/jpeg";
+    if (format == "webp") return "image/webp";
+    if (format == "avif") return "image/avif";
+    if (format == "jxl") return "image/jxl";
+    return "image/png";
+}
+
+// Quality the client's Accept header gives a media type: the most specific
+// matching range wins, so "image/avif;q=0" excludes AVIF despite "*/*".
+// With explicit_only, wildcards don't count.
+double accept_quality(beast::string_view accept, beast::string_view type, bool explicit_only = false) {
+    if (accept.empty()) return explicit_only ? 0.0 : 1.0;
+    double quality = 0.0;
+    int best = -1; // 0 = */*, 1 = image/*, 2 = exact
+    while (!accept.empty()) {
+        auto comma = accept.find(',');
+        beast::string_view range = accept.substr(0, comma);
+        accept = comma == beast::string_view::npos ? beast::string_view{} : accept.substr(comma + 1);
+
+        auto semicolon = range.find(';');
+        beast::string_view media = range.substr(0, semicolon);
+        while (!media.empty() && media.front() == ' ') media.remove_prefix(1);
+        while (!media.empty() && media.back() == ' ') media.remove_suffix(1);
+
+        int specificity = -1;
+        if (beast::iequals(media, type)) specificity = 2;
+        else if (beast::iequals(media, "image/*")) specificity = 1;
+        else if (media == "*/*") specificity = 0;
+        if (specificity <= best || (explicit_only && specificity < 2)) continue;
+
+        double q = 1.0;
+        if (semicolon != beast::string_view::npos) {
+            auto params = range.substr(semicolon);
+            auto qpos = params.find("q=");
+            if (qpos != beast::string_view::npos) {
+                q = std::atof(std::string(params.substr(qpos + 2)).c_str());
+            }
+        }
+        best = specificity;
+        quality = q;
+    }
+    return quality;
+}
+
+// Server preference, smallest output first, among what the client accepts.
+// AVIF and WebP must be named outright: plenty of clients send "*/*"
+// without being able to decode them. JPEG is the fallback for everyone.
+std::string negotiate_format(beast::string_view accept, const std::vector<std::string>& supported) {
+    for (const char* format : {"avif", "webp"}) {
+        if (std::find(supported.begin(), supported.end(), format) == supported.end()) continue;
+        if (accept_quality(accept, std::string("image/") + format, true) > 0) return format;
+    }
+    if (accept_quality(accept, "image/jpeg") <= 0 && accept_quality(accept, "image/png") > 0) {
+        return "png";
+    }
+    return "jpeg";
+}
+
+// Everything besides the input bytes that changes the encoded output
+std::string cache_params(const ThumbnailOptions& options) {
+    const EncodeOptions& encode = options.encode;
+    return options.format + ";" + std::to_string(options.width) + "x" + std::to_string(options.height) +
+           ";" + name_of(FIT_NAMES, options.fit) + ";" + name_of(GRAVITY_NAMES, options.gravity) +
+           ";q" + std::to_string(encode.quality) + ";e" + std::to_string(encode.webp_effort) +
+           "," + std::to_string(encode.avif_effort) + "," + std::to_string(encode.jxl_effort) +
+           ";c" + std::to_string(encode.png_compression) + ";" + name_of(SUBSAMPLE_NAMES, encode.jpeg_subsample) +
+           ";" + std::to_string(encode.lossless) + std::to_string(encode.jpeg_progressive) +
+           std::to_string(encode.jpeg_optimize_coding) + std::to_string(encode.png_palette);
+}
+
+// If-None-Match is a list of entity tags, or "*". Our tags are quoted, so
+// finding one anywhere in the list is a match.
+bool etag_matches(beast::string_view if_none_match, const std::string& etag) {
+    if (if_none_match.empty()) return false;
+    return if_none_match == "*" || if_none_match.find(etag) != beast::string_view::npos;
+}
+
+// IMF-fixdate, as Last-Modified and If-Modified-Since use
+std::string http_date(std::time_t time) {
+    std::tm tm;
+    gmtime_r(&time, &tm);
+    char date[40];
+    std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return date;
+}
+
+std::optional<std::time_t> parse_http_date(beast::string_view text) {
+    std::string date(text);
+    std::tm tm{};
+    const char* end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') return std::nullopt;
+    return timegm(&tm);
+}
+
+// A path given relative to the root, once ".." and symlinks are resolved.
+// Anything that would land outside the root fails with permission_denied,
+// checked lexically first so probing outside it reveals nothing.
+std::optional<std::filesystem::path> resolve_under(const std::filesystem::path& root,
+                                                   beast::string_view relative,
+                                                   std::error_code& ec) {
+    namespace fs = std::filesystem;
+    fs::path path = fs::path(std::string(relative)).relative_path().lexically_normal();
+    if (path.empty() || *path.begin() == "..") {
+        ec = std::make_error_code(std::errc::permission_denied);
+        return std::nullopt;
+    }
+    fs::path resolved = fs::canonical(root / path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    auto mismatch = std::mismatch(root.begin(), root.end(), resolved.begin(), resolved.end());
+    if (mismatch.first != root.end()) {
+        ec = std::make_error_code(std::errc::permission_denied);
+        return std::nullopt;
+    }
+    return resolved;
+}
+
+// Stands in for the content hash of a local file: the file is only read by
+// the decoder, so the key comes from what identifies this version of it.
+// Seeded apart from content hashes so the two can't collide by construction.
+uint64_t file_fingerprint(const MappedFile& file) {
+    const uint64_t fields[] = {file.device(), file.inode(), static_cast<uint64_t>(file.size()),
+                               static_cast<uint64_t>(file.mtime_nanoseconds())};
+    return Hasher::hash(fields, sizeof(fields), 0x6c6f63616c66696cULL);
+}
+
+} // namespace
+
+ThumbnailServer::ThumbnailServer(const ServerConfig& config)
+    : config_(config),
+      local_root_(config.local_root.empty() ? std::filesystem::path()
+                                            : std::filesystem::canonical(config.local_root)),
+      ioc_(config.thread_count),
+      processor_(config.encoder_threads),
+      admission_(config.max_inflight_uploads ? config.max_inflight_uploads
+                                             : config.worker_count + config.max_queue,
+                 config.max_inflight_bytes),
+      cache_(config.cache_bytes),
+      disk_cache_(config.disk_cache_dir.empty() ? nullptr
+                                                : std::make_unique<DiskCache>(config.disk_cache_dir,
+                                                                              config.disk_cache_bytes)),
+      // Room for a lookup and a write behind for every admitted request
+      disk_pool_(disk_cache_ ? std::make_unique<WorkerPool>(config.disk_cache_threads, 2 * admission_.max_requests())
+                             : nullptr),
+      pool_(config.worker_count, config.max_queue) {
 }
 
 ThumbnailServer::~ThumbnailServer() {
@@ -17,7 +418,7 @@ ThumbnailServer::~ThumbnailServer() {
 void ThumbnailServer::run() {
     try {
         // Create acceptor
-        acceptor_ = std::make_unique<tcp::acceptor>(ioc_, tcp::endpoint{tcp::v4(), static_cast<unsigned short>(port_)});
+        acceptor_ = std::make_unique<tcp::acceptor>(ioc_, tcp::endpoint{tcp::v4(), static_cast<unsigned short>(config_.port)});
         
         // Set socket options
         acceptor_->set_option(tcp::acceptor::reuse_address(true));
@@ -28,16 +429,16 @@ void ThumbnailServer::run() {
         do_accept();
         
         // Start worker threads
-        for (int i = 0; i < thread_count_; ++i) {
+        for (int i = 0; i < config_.thread_count; ++i) {
             threads_.emplace_back([this] {
                 ioc_.run();
             });
         }
         
-        std::cout << "Server running on port " << port_ << std::endl;
+        log_info("Server running on port ", config_.port);
         
     } catch (const std::exception& e) {
-        std::cerr << "Error starting server: " << e.what() << std::endl;
+        log_error("Error starting server: ", e.what());
         throw;
     }
 }
@@ -60,587 +461,780 @@ void ThumbnailServer::stop() {
     }
     
     threads_.clear();
+
+    // I/O is down, so any jobs still finishing only post into a stopped context.
+    // Workers queue disk writes, so they stop first; a disk lookup that misses
+    // after that finds the pool stopped and answers 503.
+    pool_.stop();
+    if (disk_pool_) disk_pool_->stop();
 }
 
 void ThumbnailServer::do_accept() {
+    // Each connection gets its own strand so its handlers never run concurrently
     acceptor_->async_accept(
-        [this](boost::system::error_code ec, tcp::socket socket) {
-            if (!ec) {
-                std::thread([this, socket = std::move(socket)]() mutable {
-                    handle_session(std::move(socket));
-                }).detach();
-            }
-            
-            if (running_) {
-                do_accept();
-            }
-        });
+        net::make_strand(ioc_),
+        beast::bind_front_handler(&ThumbnailServer::on_accept, this));
 }
 
-void ThumbnailServer::handle_session(tcp::socket socket) {
-    try {
-        auto session_start = std::chrono::high_resolution_clock::now();
-        beast::flat_buffer buffer;
-        http::request_parser<http::dynamic_body> parser;
-        parser.body_limit(20 * 1024 * 1024); // 20 MB limit
-        http::read(socket, buffer, parser);
-        auto req = parser.get();
-        auto upload_start = std::chrono::high_resolution_clock::now();
-        // Parse query parameters for /upload
-        std::string format = "png";
-        std::string size = "medium";
-        int target_width = 128, target_height = 128;
-        if (req.method() == http::verb::post && req.target().starts_with("/upload")) {
-            std::string target = req.target().to_string();
-            size_t qpos = target.find('?');
-            if (qpos != std::string::npos) {
-                std::string query = target.substr(qpos + 1);
-                std::regex param_regex("([a-zA-Z0-9_]+)=([^&]*)");
-                auto params_begin = std::sregex_iterator(query.begin(), query.end(), param_regex);
-                auto params_end = std::sregex_iterator();
-                for (auto it = params_begin; it != params_end; ++it) {
-                    std::string key = (*it)[1];
-                    std::string value = (*it)[2];
-                    if (key == "format") format = value;
-                    if (key == "size") size = value;
-                }
-            }
-            if (size == "small") { target_width = target_height = 64; }
-            else if (size == "large") { target_width = target_height = 256; }
-            // else medium (default) is 128x128
-        }
-        // Handle different request types
-        if (req.method() == http::verb::post && req.target().starts_with("/upload")) {
-            http::response<http::vector_body<uint8_t>> res{http::status::ok, req.version()};
-            res.set(http::field::connection, "keep-alive");
-            handle_upload(req, res, format, target_width, target_height);
-            http::write(socket, res);
-        } else if (req.method() == http::verb::get && req.target() == "/metrics") {
-            http::response<http::string_body> res{http::status::ok, req.version()};
-            res.set(http::field::connection, "keep-alive");
-            handle_metrics(res);
-            http::write(socket, res);
-        } else if (req.method() == http::verb::get) {
-            http::response<http::string_body> res{http::status::ok, req.version()};
-            res.set(http::field::connection, "keep-alive");
-            std::string path = req.target().to_string();
-            if (path == "/") path = "/index.html";
-            handle_static(path, res);
-            http::write(socket, res);
-        } else {
-            http::response<http::string_body> res{http::status::not_found, req.version()};
-            res.set(http::field::content_type, "text/plain");
-            res.set(http::field::connection, "keep-alive");
-            res.body() = "Not Found";
-            res.prepare_payload();
-            http::write(socket, res);
-        }
-        auto session_end = std::chrono::high_resolution_clock::now();
-        auto session_duration = std::chrono::duration_cast<std::chrono::microseconds>(session_end - session_start);
-        std::cout << "[Timing] Total session time: " << session_duration.count() / 1000.0 << " ms" << std::endl;
-        boost::system::error_code ec;
-        socket.shutdown(tcp::socket::shutdown_send, ec);
-    } catch (const std::exception& e) {
-        std::cerr << "Session error: " << e.what() << std::endl;
+void ThumbnailServer::on_accept(beast::error_code ec, tcp::socket socket) {
+    if (!ec) {
+        std::make_shared<Session>(std::move(socket), *this)->run();
+    }
+
+    if (running_) {
+        do_accept();
     }
 }
 
-void ThumbnailServer::handle_upload(const http::request<http::dynamic_body>& req,
-                                   http::response<http::vector_body<uint8_t>>& res,
-                                   const std::string& format,
-                                   int target_width,
-                                   int target_height) {
-    auto start_time = std::chrono::high_resolution_clock::now();
-    try {
-        // CLIENT-SIDE OPTIMIZATION SUGGESTION:
-        // For best performance, clients should compress and/or resize images before upload if possible.
-        // Parse multipart form data
-        std::string content_type = req[http::field::content_type].to_string();
-        if (content_type.find("multipart/form-data") == std::string::npos) {
-            res.result(http::status::bad_request);
-            return;
+void ThumbnailServer::handle_request(Request&& req, Session& session) {
+    RequestTarget target = split_target(req.target());
+    Route route = find_route(req.method(), target.path);
+
+    // Parse query parameters for /upload, /thumbnail and /thumb
+    ThumbnailOptions options;
+    std::string sizes = "64,128,256";
+    std::string formats;
+    bool negotiated = false;
+    QueryParams params;
+    if (upload_kind(route) != UploadKind::none || route == Route::local_thumbnail) {
+        if (params.parse(target.query) != QueryParams::Error::none) {
+            record_failure(session, FailureClass::bad_request);
+            return send_text(session, http::status::bad_request, req.version(), req.keep_alive(),
+                             "Malformed query string");
         }
-        // Extract boundary
-        std::string boundary;
-        size_t boundary_pos = content_type.find("boundary=");
-        if (boundary_pos != std::string::npos) {
-            boundary = content_type.substr(boundary_pos + 9);
-        } else {
-            res.result(http::status::bad_request);
-            return;
+        if (auto error = parse_thumbnail_options(params, config_, processor_.formats(), options)) {
+            record_failure(session, FailureClass::bad_request);
+            return send_text(session, http::status::bad_request, req.version(), req.keep_alive(), *error);
         }
-        // Parse multipart body
-        std::string body_str = boost::beast::buffers_to_string(req.body().data());
-        std::vector<uint8_t> image_data;
-        // Find file data in multipart
-        std::string boundary_marker = "--" + boundary;
-        size_t pos = body_str.find(boundary_marker);
-        if (pos == std::string::npos) {
-            res.result(http::status::bad_request);
-            return;
+        if (auto list = params.get("sizes")) sizes = std::string(*list);
+        if (auto list = params.get("formats")) formats = std::string(*list);
+
+        // Only from Accept here. Whether JPEG has to become PNG for alpha
+        // takes a look at the image, which the route does on a worker if it
+        // gets that far; a batch that lists its formats doesn't negotiate.
+        negotiated = !params.has("format") && !(route == Route::upload_batch && params.has("formats"));
+        if (negotiated) {
+            options.format = negotiate_format(req[http::field::accept], processor_.formats());
         }
-        // Find the start of file data
-        pos = body_str.find("\r\n\r\n", pos);
-        if (pos == std::string::npos) {
-            res.result(http::status::bad_request);
-            return;
+    }
+
+    switch (route) {
+    case Route::upload_batch:
+        handle_batch_upload(std::move(req), session, parse_batch_sizes(sizes, config_.max_output_edge),
+                            parse_batch_formats(formats.empty() ? options.format : formats, processor_.formats()),
+                            options.encode, negotiated && formats.empty());
+        break;
+    case Route::upload:
+        // Responds asynchronously once the worker pool has processed the image
+        handle_upload(std::move(req), session, options, negotiated);
+        break;
+    case Route::thumbnail:
+        handle_raw_upload(std::move(req), session, options, negotiated);
+        break;
+    case Route::local_thumbnail:
+        handle_local_thumbnail(std::move(req), session, params, options, negotiated);
+        break;
+    case Route::metrics: {
+        http::response<http::string_body> res{http::status::ok, req.version()};
+        res.keep_alive(req.keep_alive());
+        handle_metrics(res);
+        session.send(std::move(res));
+        break;
+    }
+    case Route::static_asset:
+        handle_static(req, target.path, session);
+        break;
+    case Route::not_found:
+        send_text(session, http::status::not_found, req.version(), req.keep_alive(), "Not Found");
+        break;
+    }
+}
+
+void ThumbnailServer::handle_upload(Request&& req,
+                                   Session& session,
+                                   const ThumbnailOptions& options,
+                                   bool vary_accept) {
+    // CLIENT-SIDE OPTIMIZATION SUGGESTION:
+    // For best performance, clients should compress and/or resize images before upload if possible.
+    // The multipart body was unpacked while it was read; only the file part was kept
+    if (!has_file_part(req)) {
+        record_failure(session, FailureClass::bad_multipart);
+        return send_text(session, http::status::bad_request, req.version(), req.keep_alive(),
+                         "Malformed multipart/form-data body");
+    }
+    process_upload(std::move(req), session, options, vary_accept);
+}
+
+void ThumbnailServer::handle_batch_upload(Request&& req,
+                                          Session& session,
+                                          std::vector<int> sizes,
+                                          std::vector<std::string> formats,
+                                          const EncodeOptions& encode,
+                                          bool vary_accept) {
+    if (sizes.empty() || formats.empty()) {
+        record_failure(session, FailureClass::bad_request);
+        return send_text(session, http::status::bad_request, req.version(), req.keep_alive(),
+                         "sizes must list 1-" + std::to_string(MAX_BATCH_SIZES) + " edges up to " +
+                         std::to_string(config_.max_output_edge) + "; formats may be " +
+                         boost::algorithm::join(processor_.formats(), ", "));
+    }
+    if (!has_file_part(req)) {
+        record_failure(session, FailureClass::bad_multipart);
+        return send_text(session, http::status::bad_request, req.version(), req.keep_alive(),
+                         "Malformed multipart/form-data body");
+    }
+    const auto& image = req.body().data();
+    std::string input_format = processor_.input_format(image.data(), image.size());
+    if (input_format.empty()) {
+        record_failure(session, FailureClass::unsupported_format);
+        return send_text(session, http::status::unsupported_media_type, req.version(), req.keep_alive(),
+                         "Unsupported image format");
+    }
+
+    auto batch = std::make_shared<BatchState>();
+    batch->formats = std::move(formats);
+    batch->encode = encode;
+    batch->input_bytes = image.size();
+    batch->labels = MetricsCollector::stage_labels(input_format, "mixed", image.size());
+    for (const auto& format : batch->formats) {
+        batch->format_labels.push_back(MetricsCollector::stage_labels(input_format, format, image.size()));
+    }
+    record_body_stages(req, batch->labels);
+    batch->start_time = session.request_start();
+
+    // Runs once every output is encoded, on whichever worker finished last
+    unsigned version = req.version();
+    bool keep_alive = req.keep_alive();
+    auto self = session.shared_from_this();
+    auto finish = [this, self, batch, version, keep_alive, vary_accept]() {
+        http::response<http::string_body> res{http::status::ok, version};
+        res.keep_alive(keep_alive);
+        if (batch->failed) {
+            record_failure(*self, FailureClass::decode);
+            res.result(http::status::internal_server_error);
+        } else {
+            auto end_time = std::chrono::steady_clock::now();
+            auto total = std::chrono::duration_cast<std::chrono::microseconds>(end_time - batch->start_time);
+            auto processing = std::chrono::duration_cast<std::chrono::microseconds>(end_time - batch->process_start);
+            metrics_.record_request(ResultSource::processed, total.count(), processing.count());
+            uint64_t output_bytes = 0;
+            for (const auto& output : batch->outputs) output_bytes += output->size();
+            metrics_.record_bytes(batch->labels, batch->input_bytes, output_bytes);
+            log_debug("[Timing] Batch: ", batch->outputs.size(), " outputs, ",
+                      "Processing: ", processing.count() / 1000.0, " ms, ",
+                      "Total: ", total.count() / 1000.0, " ms");
+
+            // One part per output, largest size first
+            std::string boundary = random_boundary();
+            size_t length = 0;
+            for (const auto& output : batch->outputs) length += output->size() + 256;
+            std::string body;
+            body.reserve(length);
+            for (size_t i = 0; i < batch->outputs.size(); ++i) {
+                int size = batch->levels[i / batch->formats.size()].size;
+                const std::string& format = batch->formats[i % batch->formats.size()];
+                const auto& output = batch->outputs[i];
+                body += "--" + boundary + "\r\n";
+                body += std::string("Content-Type: ") + content_type_for(format) + "\r\n";
+                body += "Content-Disposition: attachment; filename=\"thumbnail-" + std::to_string(size) +
+                        "." + format + "\"\r\n";
+                body += "Content-Length: " + std::to_string(output->size()) + "\r\n\r\n";
+                body.append(reinterpret_cast<const char*>(output->data()), output->size());
+                body += "\r\n";
+            }
+            body += "--" + boundary + "--\r\n";
+            res.set(http::field::content_type, "multipart/mixed; boundary=" + boundary);
+            res.set(http::field::access_control_allow_origin, "*");
+            if (vary_accept) res.set(http::field::vary, "Accept");
+            res.body() = std::move(body);
         }
-        pos += 4;
-        // Find the end of file data
-        size_t end_pos = body_str.find(boundary_marker, pos);
-        if (end_pos == std::string::npos) {
-            res.result(http::status::bad_request);
-            return;
+        bool failed = batch->failed;
+        net::post(self->get_executor(), [self, res = std::move(res), failed, labels = batch->labels]() mutable {
+            if (!failed) self->time_write(labels);
+            self->send(std::move(res));
+        });
+    };
+
+    // Decode once into a pyramid, then fan the encodes out across the pool
+    // Accept chose JPEG for the one output; it becomes PNG if the image has alpha
+    bool check_alpha = vary_accept && batch->formats.size() == 1 && batch->formats[0] == "jpeg";
+    auto job = [this, batch, finish, req = std::move(req), sizes = std::move(sizes), input_format,
+                check_alpha]() mutable {
+        batch->process_start = std::chrono::steady_clock::now();
+        try {
+            const auto& image = req.body().data();
+            if (check_alpha && processor_.has_alpha(image.data(), image.size())) {
+                batch->formats[0] = "png";
+                batch->format_labels[0] = MetricsCollector::stage_labels(input_format, "png", image.size());
+            }
+            batch->levels = processor_.create_pyramid(image.data(), image.size(), sizes);
+            for (size_t i = 0; i < batch->levels.size(); ++i) {
+                metrics_.record_stage(i == 0 ? Stage::decode : Stage::resize, batch->labels,
+                                      batch->levels[i].microseconds);
+            }
+        } catch (const std::exception& e) {
+            log_warn("Batch processing error: ", e.what());
+            batch->failed = true;
+            return finish();
         }
-        // Extract image data (remove trailing \r\n)
-        while (end_pos > pos && (body_str[end_pos-1] == '\n' || body_str[end_pos-1] == '\r')) {
-            end_pos--;
+        req = {};
+
+        size_t count = batch->levels.size() * batch->formats.size();
+        batch->outputs.resize(count);
+        batch->remaining = count;
+        for (size_t i = 0; i < count; ++i) {
+            auto encode = [this, batch, finish, i]() {
+                try {
+                    const auto& level = batch->levels[i / batch->formats.size()];
+                    size_t format = i % batch->formats.size();
+                    auto encode_start = std::chrono::steady_clock::now();
+                    batch->outputs[i] = processor_.encode(level.image, batch->formats[format], batch->encode);
+                    auto encode_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - encode_start);
+                    metrics_.record_stage(Stage::encode, batch->format_labels[format], encode_time.count());
+                } catch (const std::exception& e) {
+                    log_warn("Batch encode error: ", e.what());
+                    batch->failed = true;
+                }
+                if (batch->remaining.fetch_sub(1) == 1) {
+                    finish();
+                }
+            };
+            // A full queue only costs parallelism; this worker does the encode itself
+            if (!pool_.try_submit(encode)) {
+                encode();
+            }
         }
-        image_data.assign(body_str.begin() + pos, body_str.begin() + end_pos);
-        auto upload_end = std::chrono::high_resolution_clock::now();
-        // Process thumbnail
-        auto process_start = std::chrono::high_resolution_clock::now();
-        std::vector<uint8_t> thumbnail = processor_.create_thumbnail(image_data, target_width, target_height, format);
-        auto process_end = std::chrono::high_resolution_clock::now();
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto upload_duration = std::chrono::duration_cast<std::chrono::microseconds>(upload_end - start_time);
-        auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(process_end - process_start);
-        auto response_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - process_end);
-        auto total_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-        // Record metrics
-        metrics_.record_request(total_duration.count(), process_duration.count());
-        // Timing logs
-        std::cout << "[Timing] Upload: " << upload_duration.count() / 1000.0 << " ms, "
-                  << "Processing: " << process_duration.count() / 1000.0 << " ms, "
-                  << "Response: " << response_duration.count() / 1000.0 << " ms, "
-                  << "Total: " << total_duration.count() / 1000.0 << " ms" << std::endl;
-        // Set response Content-Type
-        if (format == "jpeg")
-            res.set(http::field::content_type, "image/jpeg");
-        else if (format == "webp")
-            res.set(http::field::content_type, "image/webp");
-        else
-            res.set(http::field::content_type, "image/png");
-        res.set(http::field::access_control_allow_origin, "*");
-        res.set(http::field::connection, "keep-alive");
-        res.body() = std::move(thumbnail);
-        res.prepare_payload();
-    } catch (const std::exception& e) {
-        std::cerr << "Upload processing error: " << e.what() << std::endl;
-        res.result(http::status::internal_server_error);
+    };
+
+    if (!pool_.try_submit(std::move(job))) {
+        record_failure(session, FailureClass::shed);
+        send_overloaded(session, version, keep_alive);
     }
 }
 
-void ThumbnailServer::handle_metrics(http::response<http::string_body>& res) {
-    res.set(http::field::content_type, "text/plain");
-    res.body() = metrics_.get_prometheus_metrics();
-    res.prepare_payload();
+void ThumbnailServer::handle_raw_upload(Request&& req,
+                                       Session& session,
+                                       const ThumbnailOptions& options,
+                                   bool vary_accept) {
+    // The body is the image itself; nothing to unpack
+    if (req.body().data().empty()) {
+        record_failure(session, FailureClass::bad_request);
+        return send_text(session, http::status::bad_request, req.version(), req.keep_alive(),
+                         "Empty image body");
+    }
+    process_upload(std::move(req), session, options, vary_accept);
 }
 
-void ThumbnailServer::handle_static(const std::string& path, http::response<http::string_body>& res) {
-    std::string content = get_static_content(path);
-    
-    if (content.empty()) {
-        res.result(http::status::not_found);
-        res.set(http::field::content_type, "text/plain");
-        res.body() = "Not Found";
-    } else {
-        if (path.find(".html") != std::string::npos) {
-            res.set(http::field::content_type, "text/html");
-        } else if (path.find(".css") != std::string::npos) {
-            res.set(http::field::content_type, "text/css");
-        } else if (path.find(".js") != std::string::npos) {
-            res.set(http::field::content_type, "application/javascript");
-        }
-        res.body() = content;
+void ThumbnailServer::process_upload(Request&& req,
+                                    Session& session,
+                                    const ThumbnailOptions& options,
+                                    bool vary_accept,
+                                    bool format_settled) {
+    // Every outcome is timed from the header, as failures are
+    auto start_time = session.request_start();
+
+    // The body was fingerprinted while it was read, so identical uploads can
+    // be answered without touching libvips
+    const auto& image = req.body().data();
+    if (vary_accept && !format_settled && options.format == "jpeg" &&
+        !processor_.input_format(image.data(), image.size()).empty()) {
+        // The format is part of the cache key, so it has to be settled first
+        return negotiate_alpha(std::move(req), session, options);
     }
-    
-    res.prepare_payload();
+    ThumbnailKey key{req.body().content_hash(), image.size(),
+                     cache_params(options)};
+    if (try_send_cached(req, session, key, options.format, vary_accept)) {
+        return;
+    }
+
+    // Sniff the magic bytes so non-images are refused here rather than in a worker
+    std::string input_format = processor_.input_format(image.data(), image.size());
+    if (input_format.empty()) {
+        record_failure(session, FailureClass::unsupported_format);
+        return send_text(session, http::status::unsupported_media_type, req.version(), req.keep_alive(),
+                         "Unsupported image format");
+    }
+    StageLabels labels = MetricsCollector::stage_labels(input_format, options.format, image.size());
+    record_body_stages(req, labels);
+
+    Job job;
+    job.key = std::move(key);
+    job.options = options;
+    job.labels = labels;
+    job.vary_accept = vary_accept;
+    job.start_time = start_time;
+    job.input_end = std::chrono::steady_clock::now();
+    unsigned version = req.version();
+    bool keep_alive = req.keep_alive();
+    // The job owns the request so libvips can read the image straight out of its body
+    auto body = std::make_shared<Request>(std::move(req));
+    job.data = body->body().data().data();
+    job.size = body->body().data().size();
+    job.input = std::move(body);
+    start_job(std::move(job), session, version, keep_alive);
 }
 
-std::string ThumbnailServer::get_static_content(const std::string& path) {
-    if (path == "/index.html") {
-        return R"(
-<!DOCTYPE html>
-<html lang='en'>
-<head>
-    <meta charset='UTF-8'>
-    <meta name='viewport' content='width=device-width, initial-scale=1.0'>
-    <title>ThumbnailGen - Fast Image Thumbnailing</title>
-    <link rel="icon" type="image/svg+xml" href="data:image/svg+xml,%3Csvg xmlns='http://www.w3.org/2000/svg' viewBox='0 0 64 64'%3E%3Ctext y='52' font-size='52'%3E🚀%3C/text%3E%3C/svg%3E">
-    <style>
-        body {
-            font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, sans-serif;
-            max-width: 600px;
-            margin: 0 auto;
-            padding: 20px;
-            background: #f5f5f5;
-        }
-        .container {
-            background: white;
-            border-radius: 14px;
-            padding: 36px 24px 28px 24px;
-            box-shadow: 0 2px 18px rgba(0,0,0,0.10);
-            margin-top: 32px;
-            transition: box-shadow 0.2s;
-        }
-        h1 {
-            color: #007bff;
-            text-align: center;
-            margin-bottom: 18px;
-            font-size: 2.1rem;
-            letter-spacing: 0.5px;
-            display: flex;
-            align-items: center;
-            justify-content: center;
-            gap: 8px;
-        }
-        .step {
-            margin-bottom: 18px;
-        }
-        .step label {
-            font-weight: 500;
-            margin-right: 8px;
-        }
-        .info {
-            font-size: 0.95em;
-            color: #666;
-            margin-left: 6px;
-            cursor: pointer;
-            border-bottom: 1px dotted #666;
-        }
-        #drop {
-            width: 100%;
-            min-height: 120px;
-            border: 2.5px dashed #007bff;
-            border-radius: 8px;
-            display: flex;
-            align-items: center;
-            justify-content: center;
-            font-size: 1.1em;
-            color: #007bff;
-            background: #f8faff;
-            margin-bottom: 10px;
-            transition: border-color 0.2s, background 0.2s;
-            outline: none;
-        }
-        #drop.dragover {
-            border-color: #0056b3;
-            background: #e6f0ff;
-        }
-        #drop:focus {
-            border-color: #0056b3;
-            background: #e6f0ff;
-        }
-        #controls {
-            display: flex;
-            gap: 18px;
-            flex-wrap: wrap;
-            align-items: center;
-            margin-bottom: 10px;
-        }
-        #controls label {
-            margin-bottom: 0;
-        }
-        select {
-            padding: 4px 8px;
-            border-radius: 4px;
-            border: 1px solid #ccc;
-            font-size: 1em;
-        }
-        #generateBtn {
-            background: #007bff;
-            color: white;
-            border: none;
-            border-radius: 6px;
-            padding: 10px 24px;
-            font-size: 1.1em;
-            cursor: pointer;
-            margin-top: 10px;
-            transition: background 0.2s;
-            display: flex;
-            align-items: center;
-            gap: 8px;
-        }
-        #generateBtn:disabled {
-            background: #b3d1ff;
-            cursor: not-allowed;
-        }
-        #generateBtn .spinner {
-            display: inline-block;
-            width: 20px;
-            height: 20px;
-            border: 3px solid #fff;
-            border-top: 3px solid #007bff;
-            border-radius: 50%;
-            animation: spin 1s linear infinite;
-        }
-        .results {
-            display: flex;
-            gap: 24px;
-            flex-wrap: wrap;
-            justify-content: center;
-            margin-top: 24px;
-            transition: opacity 0.3s;
-        }
-        .image-container {
-            text-align: center;
-            flex: 1 1 180px;
-        }
-        .image-container img {
-            max-width: 180px;
-            max-height: 180px;
-            border-radius: 6px;
-            box-shadow: 0 2px 8px rgba(0,0,0,0.08);
-            margin-bottom: 6px;
-        }
-        .image-container h3 {
-            margin: 10px 0 5px 0;
-            color: #333;
-            font-size: 1em;
-        }
-        .meta {
-            font-size: 0.95em;
-            color: #888;
-            margin-bottom: 4px;
-        }
-        .download-btn {
-            display: inline-block;
-            margin-top: 8px;
-            background: #28a745;
-            color: white;
-            padding: 6px 16px;
-            border-radius: 4px;
-            text-decoration: none;
-            font-size: 0.98em;
-            transition: background 0.2s;
-        }
-        .download-btn:hover {
-            background: #218838;
-        }
-        .stats {
-            background: #f8f9fa;
-            padding: 15px;
-            border-radius: 4px;
-            margin-top: 20px;
-            font-family: monospace;
-            font-size: 1em;
-        }
-        .error {
-            color: #dc3545;
-            background: #f8d7da;
-            padding: 10px;
-            border-radius: 4px;
-            margin: 10px 0;
-            text-align: center;
+void ThumbnailServer::negotiate_alpha(Request&& req, Session& session, ThumbnailOptions options) {
+    auto self = session.shared_from_this();
+    auto request = std::make_shared<Request>(std::move(req));
+    auto check = [this, self, request, options]() mutable {
+        const auto& image = request->body().data();
+        options.format = negotiate_output(*request, image.data(), image.size());
+        net::post(self->get_executor(), [this, self, request, options]() {
+            process_upload(std::move(*request), *self, options, true, true);
+        });
+    };
+    if (!pool_.try_submit(std::move(check))) {
+        record_failure(session, FailureClass::shed);
+        send_overloaded(session, request->version(), request->keep_alive());
+    }
+}
+
+void ThumbnailServer::start_job(Job job, Session& session, unsigned version, bool keep_alive) {
+    // Every request waiting on this key is answered through its own callback,
+    // posted back to its session's strand
+    auto self = session.shared_from_this();
+    auto deliver = [this, self, version, keep_alive, format = job.options.format, etag = job.key.etag(),
+                    vary_accept = job.vary_accept, last_modified = job.last_modified,
+                    start_time = job.start_time, labels = job.labels,
+                    input_bytes = static_cast<uint64_t>(job.size)](const FlightResult& result, bool leader) {
+        net::post(self->get_executor(), [this, self, version, keep_alive, format, etag, vary_accept,
+                                         last_modified, start_time, labels, input_bytes, result, leader]() {
+            if (result.status == FlightResult::Status::overloaded) {
+                record_failure(*self, FailureClass::shed);
+                return send_overloaded(*self, version, keep_alive);
+            }
+            http::response<shared_buffer_body> res{http::status::ok, version};
+            res.keep_alive(keep_alive);
+            if (result.status == FlightResult::Status::ok) {
+                auto total = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_time);
+                // Followers only waited; the leader alone is credited with the work
+                metrics_.record_request(leader ? result.source : ResultSource::coalesced, total.count(),
+                                        result.processing_microseconds);
+                metrics_.record_bytes(labels, input_bytes, result.thumbnail->size());
+                self->time_write(labels);
+                res.set(http::field::content_type, content_type_for(format));
+                res.set(http::field::access_control_allow_origin, "*");
+                res.set(http::field::etag, etag);
+                if (!last_modified.empty()) res.set(http::field::last_modified, last_modified);
+                if (vary_accept) res.set(http::field::vary, "Accept");
+                res.body() = result.thumbnail;
+            } else {
+                record_failure(*self, FailureClass::decode);
+                res.result(http::status::internal_server_error);
+            }
+            self->send(std::move(res));
+        });
+    };
+
+    // An identical job is already running; share its result
+    if (!flights_.join(job.key, std::move(deliver))) {
+        metrics_.record_coalesced();
+        return;
+    }
+
+    // With a disk tier, look there first on its own threads, so a thumbnail
+    // already on disk never waits behind decodes for a worker
+    if (disk_pool_) {
+        auto lookup = [this, job]() mutable { lookup_disk(std::move(job)); };
+        if (disk_pool_->try_submit(std::move(lookup))) {
+            return;
         }
-        .success {
-            color: #28a745;
-            background: #e6f9ed;
-            padding: 10px;
-            border-radius: 4px;
-            margin: 10px 0;
-            text-align: center;
+        // Lookups are backed up; decoding is slower but still right
+    }
+    submit_processing(std::move(job));
+}
+
+void ThumbnailServer::lookup_disk(Job job) {
+    auto lookup_start = std::chrono::steady_clock::now();
+    auto thumbnail = disk_cache_->get(job.key);
+    auto lookup_end = std::chrono::steady_clock::now();
+    auto lookup_duration = std::chrono::duration_cast<std::chrono::microseconds>(lookup_end - lookup_start);
+    metrics_.record_disk_lookup(thumbnail != nullptr, lookup_duration.count());
+    if (!thumbnail) {
+        return submit_processing(std::move(job));
+    }
+
+    auto input_duration = std::chrono::duration_cast<std::chrono::microseconds>(job.input_end - job.start_time);
+    auto queue_duration = std::chrono::duration_cast<std::chrono::microseconds>(lookup_start - job.input_end);
+    auto total_duration = std::chrono::duration_cast<std::chrono::microseconds>(lookup_end - job.start_time);
+    log_debug("[Timing] Input: ", input_duration.count() / 1000.0, " ms, ",
+              "Queue: ", queue_duration.count() / 1000.0, " ms, ",
+              "Disk cache: ", lookup_duration.count() / 1000.0, " ms, ",
+              "Total: ", total_duration.count() / 1000.0, " ms");
+    // Promoted so the next request for it is answered on the I/O thread
+    cache_.put(job.key, thumbnail);
+    FlightResult result;
+    result.status = FlightResult::Status::ok;
+    result.source = ResultSource::disk_cache;
+    result.thumbnail = std::move(thumbnail);
+    job.input.reset();
+    flights_.complete(job.key, result);
+}
+
+void ThumbnailServer::submit_processing(Job job) {
+    ThumbnailKey key = job.key;
+    auto work = [this, job = std::move(job)]() mutable {
+        FlightResult result;
+        try {
+            auto process_start = std::chrono::steady_clock::now();
+            StageTimings timings;
+            auto thumbnail = processor_.create_thumbnail(job.data, job.size, job.options, &timings);
+            metrics_.record_stage(Stage::decode, job.labels, timings.decode_microseconds);
+            metrics_.record_stage(Stage::encode, job.labels, timings.encode_microseconds);
+            auto process_end = std::chrono::steady_clock::now();
+            auto end_time = std::chrono::steady_clock::now();
+            auto input_duration = std::chrono::duration_cast<std::chrono::microseconds>(job.input_end - job.start_time);
+            auto queue_duration = std::chrono::duration_cast<std::chrono::microseconds>(process_start - job.input_end);
+            auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(process_end - process_start);
+            auto total_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - job.start_time);
+            // Timing logs
+            log_debug("[Timing] Input: ", input_duration.count() / 1000.0, " ms, ",
+                      "Queue: ", queue_duration.count() / 1000.0, " ms, ",
+                      "Processing: ", process_duration.count() / 1000.0, " ms, ",
+                      "Total: ", total_duration.count() / 1000.0, " ms");
+            // Cache before completing so a request arriving just after the
+            // flight lands finds the result rather than starting a new job
+            cache_.put(job.key, thumbnail);
+            result.status = FlightResult::Status::ok;
+            result.thumbnail = std::move(thumbnail);
+            result.processing_microseconds = process_duration.count();
+        } catch (const std::exception& e) {
+            log_warn("Thumbnail processing error: ", e.what());
         }
-        @media (max-width: 700px) {
-            .container { padding: 12px 2vw; }
-            .results { flex-direction: column; gap: 12px; }
-            .image-container img { max-width: 98vw; }
+        // The input is no longer needed; don't hold it until the writes finish
+        job.input.reset();
+        flights_.complete(job.key, result);
+
+        // Written behind, once every waiter has its answer. Dropped if the
+        // disk threads are backed up; that only costs a later miss.
+        if (disk_pool_ && result.thumbnail) {
+            disk_pool_->try_submit([this, key = job.key, thumbnail = result.thumbnail]() {
+                disk_cache_->put(key, *thumbnail);
+            });
         }
-        @keyframes spin { 0% { transform: rotate(0deg); } 100% { transform: rotate(360deg); } }
-    </style>
-</head>
-<body>
-    <div class="container">
-        <h1><span aria-label="rocket" role="img">🚀</span> <span>ThumbnailGen</span></h1>
-        <div class="step">
-            <label for="fileInput">1. Upload Image:</label>
-            <div id="drop" tabindex="0" aria-label="Drop an image here or click to select">Drop an image here or click to select</div>
-        </div>
-        <div class="step" id="controls">
-            <label for="format">2. Format:</label>
-            <select id="format" aria-label="Output format">
-                <option value="png">PNG</option>
-                <option value="jpeg">JPEG</option>
-                <option value="webp">WebP</option>
-            </select>
-            <span class="info" title="PNG: best for transparency. JPEG: best for photos. WebP: modern, small size.">?</span>
-            <label for="size">Size:</label>
-            <select id="size" aria-label="Thumbnail size">
-                <option value="small">Small (64x64)</option>
-                <option value="medium" selected>Medium (128x128)</option>
-                <option value="large">Large (256x256)</option>
-            </select>
-            <span class="info" title="Small: icons. Medium: previews. Large: detail.">?</span>
-        </div>
-        <button id="generateBtn" disabled aria-label="Generate Thumbnail">Generate Thumbnail</button>
-        <div id="output" class="results" aria-live="polite"></div>
-        <div id="stats" class="stats" style="display: none;"></div>
-        <div id="error" class="error" style="display: none;"></div>
-        <div id="success" class="success" style="display: none;"></div>
-    </div>
-    <script>
-        const drop = document.getElementById('drop');
-        const output = document.getElementById('output');
-        const stats = document.getElementById('stats');
-        const errorDiv = document.getElementById('error');
-        const successDiv = document.getElementById('success');
-        const formatSelect = document.getElementById('format');
-        const sizeSelect = document.getElementById('size');
-        const generateBtn = document.getElementById('generateBtn');
-        let selectedFile = null;
-        let origMeta = {};
-        // Enable button only if file is selected
-        function updateButtonState() {
-            generateBtn.disabled = !selectedFile;
+    };
+
+    // Every waiter is answered with a 503 and counted as shed
+    if (!pool_.try_submit(std::move(work))) {
+        FlightResult shed;
+        shed.status = FlightResult::Status::overloaded;
+        flights_.complete(key, shed);
+    }
+}
+
+void ThumbnailServer::handle_local_thumbnail(Request&& req,
+                                             Session& session,
+                                             const QueryParams& params,
+                                             ThumbnailOptions options,
+                                             bool vary_accept) {
+    LocalOriginal original;
+    original.start_time = session.request_start();
+    if (local_root_.empty()) {
+        return send_text(session, http::status::not_found, req.version(), req.keep_alive(), "Not Found");
+    }
+    auto relative = params.get("path");
+    if (!relative || relative->empty() || relative->find('\0') != beast::string_view::npos) {
+        record_failure(session, FailureClass::bad_request);
+        return send_text(session, http::status::bad_request, req.version(), req.keep_alive(),
+                         "path is required");
+    }
+    original.options = std::move(options);
+
+    // Resolving, opening and sniffing the original all wait on the volume,
+    // which may be slow network storage; a worker does them and the answer
+    // comes back on the session's strand
+    auto self = session.shared_from_this();
+    auto request = std::make_shared<Request>(std::move(req));
+    auto open = [this, self, request, relative = std::string(*relative), original = std::move(original),
+                 vary_accept]() mutable {
+        auto open_start = std::chrono::steady_clock::now();
+        if (auto path = resolve_under(local_root_, relative, original.error)) {
+            try {
+                // No larger than an upload may be; admission assumes as much
+                original.file = MappedFile::open(path->string(), config_.body_limit);
+            } catch (const std::system_error& e) {
+                original.error = e.code();
+            }
         }
-        // Keyboard navigation for drop area
-        drop.addEventListener('keydown', e => {
-            if (e.key === 'Enter' || e.key === ' ') {
-                e.preventDefault();
-                openFileDialog();
+        if (original.file) {
+            // Only the header pages are touched here; the decoder reads the rest
+            original.input_format = processor_.input_format(original.file->data(), original.file->size());
+            if (vary_accept && !original.input_format.empty()) {
+                original.options.format = negotiate_output(*request, original.file->data(), original.file->size());
             }
+        }
+        original.read_microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - open_start).count();
+        net::post(self->get_executor(), [this, self, request, original = std::move(original), vary_accept]() mutable {
+            answer_local_thumbnail(*request, *self, std::move(original), vary_accept);
         });
-        // Drag and drop
-        drop.addEventListener('dragover', e => {
-            e.preventDefault();
-            drop.classList.add('dragover');
-        });
-        drop.addEventListener('dragleave', e => {
-            e.preventDefault();
-            drop.classList.remove('dragover');
-        });
-        drop.addEventListener('drop', e => {
-            e.preventDefault();
-            drop.classList.remove('dragover');
-            const file = e.dataTransfer.files[0];
-            if (file) selectFile(file);
-        });
-        // Click to select
-        drop.addEventListener('click', openFileDialog);
-        function openFileDialog() {
-            const input = document.createElement('input');
-            input.type = 'file';
-            input.accept = 'image/*';
-            input.onchange = (e) => {
-                const file = e.target.files[0];
-                if (file) selectFile(file);
-            };
-            input.click();
+    };
+    if (!pool_.try_submit(std::move(open))) {
+        record_failure(session, FailureClass::shed);
+        send_overloaded(session, request->version(), request->keep_alive());
+    }
+}
+
+void ThumbnailServer::answer_local_thumbnail(const Request& req,
+                                             Session& session,
+                                             LocalOriginal original,
+                                             bool vary_accept) {
+    std::error_code ec = original.error;
+    if (ec == std::errc::file_too_large) {
+        record_failure(session, FailureClass::too_large);
+        return send_text(session, http::status::payload_too_large, req.version(), req.keep_alive(),
+                         "File Too Large");
+    }
+    if (ec) {
+        record_failure(session, FailureClass::bad_request);
+        if (ec == std::errc::permission_denied || ec == std::errc::operation_not_permitted ||
+            ec == std::errc::too_many_symbolic_link_levels) {
+            return send_text(session, http::status::forbidden, req.version(), req.keep_alive(), "Forbidden");
         }
-        function selectFile(file) {
-            selectedFile = file;
-            updateButtonState();
-            errorDiv.style.display = 'none';
-            successDiv.style.display = 'none';
-            output.innerHTML = '';
-            stats.style.display = 'none';
-            // Show original image preview and meta
-            const origURL = URL.createObjectURL(file);
-            const img = new window.Image();
-            img.onload = function() {
-                origMeta = { width: img.naturalWidth, height: img.naturalHeight, type: file.type };
-                renderOriginal(origURL, file, origMeta);
-            };
-            img.src = origURL;
+        if (ec == std::errc::no_such_file_or_directory || ec == std::errc::not_a_directory ||
+            ec == std::errc::is_a_directory || ec == std::errc::invalid_argument) {
+            return send_text(session, http::status::not_found, req.version(), req.keep_alive(), "Not Found");
         }
-        function renderOriginal(url, file, meta) {
-            output.innerHTML = '';
-            const origContainer = document.createElement('div');
-            origContainer.className = 'image-container';
-            origContainer.innerHTML = `
-                <h3>Original (${(file.size / 1024).toFixed(1)} KB)</h3>
-                <img src="${url}" alt="Original image preview">
-                <div class="meta">${meta.type || 'Unknown type'}<br>${meta.width || '?'}×${meta.height || '?'} px</div>
-            `;
-            output.appendChild(origContainer);
+        log_warn("Cannot open local original: ", ec.message());
+        return send_text(session, http::status::internal_server_error, req.version(), req.keep_alive(),
+                         "Cannot read file");
+    }
+    if (original.input_format.empty()) {
+        record_failure(session, FailureClass::unsupported_format);
+        return send_text(session, http::status::unsupported_media_type, req.version(), req.keep_alive(),
+                         "Unsupported image format");
+    }
+    std::shared_ptr<const MappedFile> file = std::move(original.file);
+    ThumbnailOptions& options = original.options;
+
+    // Validators come from the file's identity and mtime, so revalidating an
+    // unchanged original costs a stat and a mapping, not a decode
+    ThumbnailKey key{file_fingerprint(*file), file->size(), cache_params(options)};
+    std::string etag = key.etag();
+    std::string last_modified = http_date(file->mtime());
+    beast::string_view if_none_match = req[http::field::if_none_match];
+    bool not_modified = false;
+    if (!if_none_match.empty()) {
+        not_modified = etag_matches(if_none_match, etag);
+    } else if (auto since = parse_http_date(req[http::field::if_modified_since])) {
+        not_modified = file->mtime() <= *since;
+    }
+    if (not_modified) {
+        http::response<http::empty_body> res{http::status::not_modified, req.version()};
+        res.set(http::field::etag, etag);
+        res.set(http::field::last_modified, last_modified);
+        res.set(http::field::access_control_allow_origin, "*");
+        if (vary_accept) res.set(http::field::vary, "Accept");
+        res.keep_alive(req.keep_alive());
+        return session.send(std::move(res));
+    }
+    if (try_send_cached(req, session, key, options.format, vary_accept, last_modified)) {
+        return;
+    }
+
+    // Admitted like an upload of the same size, for the decode it will cost
+    auto ticket = admission_.try_acquire(file->size());
+    if (!ticket) {
+        record_failure(session, FailureClass::shed);
+        return send_overloaded(session, req.version(), req.keep_alive());
+    }
+    session.hold_admission(std::move(*ticket));
+
+    // No body was read, so opening the original is the read stage
+    StageLabels labels = MetricsCollector::stage_labels(original.input_format, options.format, file->size());
+    metrics_.record_stage(Stage::read, labels, original.read_microseconds);
+
+    Job job;
+    job.key = std::move(key);
+    job.options = std::move(options);
+    job.labels = labels;
+    job.vary_accept = vary_accept;
+    job.last_modified = std::move(last_modified);
+    job.start_time = original.start_time;
+    job.input_end = std::chrono::steady_clock::now();
+    job.data = file->data();
+    job.size = file->size();
+    job.input = std::move(file);
+    start_job(std::move(job), session, req.version(), req.keep_alive());
+}
+
+void ThumbnailServer::record_body_stages(const Request& req, const StageLabels& labels) {
+    metrics_.record_stage(Stage::read, labels, req.body().read_microseconds());
+    if (req.body().multipart()) {
+        metrics_.record_stage(Stage::parse, labels, req.body().parse_microseconds());
+    }
+}
+
+bool ThumbnailServer::try_send_cached(const Request& req, Session& session, const ThumbnailKey& key,
+                                      const std::string& format, bool vary_accept,
+                                      const std::string& last_modified) {
+    if (!cache_.enabled()) {
+        return false;
+    }
+
+    // A 304 is only trusted for thumbnails we still hold, so an If-None-Match
+    // can never vouch for input that was never accepted
+    auto thumbnail = cache_.get(key);
+    if (!thumbnail) {
+        return false;
+    }
+    std::string etag = key.etag();
+
+    // Timed like any other request, from when the header arrived
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - session.request_start());
+    metrics_.record_request(ResultSource::memory_cache, elapsed.count());
+
+    if (etag_matches(req[http::field::if_none_match], etag)) {
+        http::response<http::empty_body> res{http::status::not_modified, req.version()};
+        res.set(http::field::etag, etag);
+        if (!last_modified.empty()) res.set(http::field::last_modified, last_modified);
+        res.set(http::field::access_control_allow_origin, "*");
+        if (vary_accept) res.set(http::field::vary, "Accept");
+        res.keep_alive(req.keep_alive());
+        session.send(std::move(res));
+        return true;
+    }
+
+    http::response<shared_buffer_body> res{http::status::ok, req.version()};
+    res.set(http::field::content_type, content_type_for(format));
+    res.set(http::field::access_control_allow_origin, "*");
+    res.set(http::field::etag, etag);
+    if (!last_modified.empty()) res.set(http::field::last_modified, last_modified);
+    if (vary_accept) res.set(http::field::vary, "Accept");
+    res.keep_alive(req.keep_alive());
+    res.body() = std::move(thumbnail);
+    session.send(std::move(res));
+    return true;
+}
+
+std::string ThumbnailServer::negotiate_output(const Request& req, const uint8_t* image, size_t size) const {
+    // Pick the smallest format the client takes. JPEG can't carry alpha, so
+    // transparent images fall back to PNG.
+    std::string format = negotiate_format(req[http::field::accept], processor_.formats());
+    if (format == "jpeg" && processor_.has_alpha(image, size)) {
+        format = "png";
+    }
+    return format;
+}
+
+bool ThumbnailServer::admit_request(Request& header,
+                                    boost::optional<std::uint64_t> content_length,
+                                    Session& session) {
+    UploadKind kind = upload_kind(find_route(header.method(), split_target(header.target()).path));
+    if (kind == UploadKind::none) {
+        return true;
+    }
+
+    // The body is still unread, so the connection can't be reused after a rejection
+    if (content_length && *content_length > config_.body_limit) {
+        record_failure(session, FailureClass::too_large);
+        send_text(session, http::status::payload_too_large, header.version(), false, "Payload Too Large");
+        return false;
+    }
+
+    beast::string_view content_type = header[http::field::content_type];
+    std::optional<std::string> boundary;
+    if (kind == UploadKind::multipart) {
+        boundary = MultipartParser::parse_boundary(std::string_view(content_type.data(), content_type.size()));
+        if (!boundary) {
+            record_failure(session, FailureClass::bad_multipart);
+            send_text(session, http::status::bad_request, header.version(), false,
+                      "Expected multipart/form-data with a boundary");
+            return false;
+        }
+    } else {
+        // Raw uploads may label the bytes as any image type or leave them generic;
+        // the actual format is sniffed from the data
+        beast::string_view media_type = content_type.substr(0, content_type.find(';'));
+        bool acceptable = media_type.empty() ||
+                          beast::iequals(media_type, "application/octet-stream") ||
+                          (media_type.size() > 6 && beast::iequals(media_type.substr(0, 6), "image/"));
+        if (!acceptable) {
+            record_failure(session, FailureClass::unsupported_format);
+            send_text(session, http::status::unsupported_media_type, header.version(), false,
+                      "Expected an image or application/octet-stream body");
+            return false;
         }
-        // Generate button click
-        generateBtn.addEventListener('click', async () => {
-            if (!selectedFile) return;
-            output.innerHTML = '';
-            stats.style.display = 'none';
-            errorDiv.style.display = 'none';
-            successDiv.style.display = 'none';
-            // Show original image preview again
-            const origURL = URL.createObjectURL(selectedFile);
-            renderOriginal(origURL, selectedFile, origMeta);
-            // Show loading state
-            const loadingContainer = document.createElement('div');
-            loadingContainer.className = 'image-container';
-            loadingContainer.innerHTML = `
-                <h3>Thumbnail</h3>
-                <div style="width: 100px; height: 100px; background: #f0f0f0; display: flex; align-items: center; justify-content: center; border-radius: 4px;">
-                    <span class="spinner" aria-label="Processing"></span>
-                </div>
-            `;
-            output.appendChild(loadingContainer);
-            // Disable button and show spinner
-            generateBtn.disabled = true;
-            generateBtn.innerHTML = '<span class="spinner"></span> Generating...';
-            try {
-                const form = new FormData();
-                form.append('file', selectedFile);
-                const format = formatSelect.value;
-                const size = sizeSelect.value;
-                const url = `/upload?format=${encodeURIComponent(format)}&size=${encodeURIComponent(size)}`;
-                const start = performance.now();
-                const resp = await fetch(url, { method: 'POST', body: form });
-                const end = performance.now();
-                if (!resp.ok) {
-                    throw new Error(`HTTP ${resp.status}: ${resp.statusText}`);
-                }
-                const blob = await resp.blob();
-                const duration = end - start;
-                // Get thumbnail dimensions
-                const thumbURL = URL.createObjectURL(blob);
-                const thumbImg = new window.Image();
-                thumbImg.onload = function() {
-                    loadingContainer.innerHTML = `
-                        <h3>Thumbnail (${(blob.size / 1024).toFixed(1)} KB)</h3>
-                        <img src="${thumbURL}" alt="Thumbnail preview"><br>
-                        <div class="meta">${blob.type || 'Unknown type'}<br>${thumbImg.naturalWidth}×${thumbImg.naturalHeight} px</div>
-                        <a class="download-btn" href="${thumbURL}" download="thumbnail.${format}">Download</a>
-                    `;
-                    // Show stats
-                    stats.style.display = 'block';
-                    stats.innerHTML = `
-                        <strong>Performance Metrics:</strong><br>
-                        Total round-trip time: ${duration.toFixed(1)} ms<br>
-                        Thumbnail size: ${(blob.size / 1024).toFixed(1)} KB<br>
-                        Compression ratio: ${(selectedFile.size / blob.size).toFixed(1)}:1
-                    `;
-                    // Show success message
-                    successDiv.style.display = 'block';
-                    successDiv.textContent = 'Thumbnail generated successfully!';
-                    // Auto-scroll to results
-                    setTimeout(() => {
-                        output.scrollIntoView({ behavior: 'smooth', block: 'center' });
-                    }, 100);
-                };
-                thumbImg.src = thumbURL;
-            } catch (error) {
-                loadingContainer.innerHTML = '';
-                errorDiv.style.display = 'block';
-                errorDiv.textContent = `Error processing image: ${error.message}`;
-            } finally {
-                generateBtn.disabled = false;
-                generateBtn.innerHTML = 'Generate Thumbnail';
-            }
-        });
-        // Enable button if file is selected
-        updateButtonState();
-        // Spinner animation (for browsers that don't support @keyframes in style tag)
-        const style = document.createElement('style');
-        style.innerHTML = `@keyframes spin { 0% { transform: rotate(0deg); } 100% { transform: rotate(360deg); } }`;
-        document.head.appendChild(style);
-        // Accessibility: focus drop area on page load
-        window.onload = () => { drop.focus(); };
-    </script>
-</body>
-</html>
-        )";
     }
-    
-    return "";
-} 
\ No newline at end of file
+
+    // Chunked uploads are charged the worst case
+    auto ticket = admission_.try_acquire(content_length ? *content_length : config_.body_limit);
+    if (!ticket) {
+        record_failure(session, FailureClass::shed);
+        send_overloaded(session, header.version(), false);
+        return false;
+    }
+
+    // Unpack a multipart body as it arrives so only the file part is buffered
+    if (boundary) {
+        header.body().expect_multipart(std::move(*boundary));
+    }
+
+    session.hold_admission(std::move(*ticket));
+    return true;
+}
+
+void ThumbnailServer::send_overloaded(Session& session, unsigned version, bool keep_alive) {
+    http::response<http::string_body> res{http::status::service_unavailable, version};
+    res.set(http::field::content_type, "text/plain");
+    res.set(http::field::retry_after, std::to_string(config_.retry_after.count()));
+    res.keep_alive(keep_alive);
+    res.body() = "Service Unavailable";
+    session.send(std::move(res));
+}
+
+void ThumbnailServer::record_failure(Session& session, FailureClass failure) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - session.request_start());
+    metrics_.record_failure(failure, elapsed.count());
+}
+
+void ThumbnailServer::send_text(Session& session, http::status status, unsigned version,
+                                bool keep_alive, const std::string& message) {
+    http::response<http::string_body> res{status, version};
+    res.set(http::field::content_type, "text/plain");
+    res.keep_alive(keep_alive);
+    res.body() = message;
+    session.send(std::move(res));
+}
+
+void ThumbnailServer::handle_metrics(http::response<http::string_body>& res) {
+    metrics_.update_load(pool_.queue_depth(), admission_.in_flight(), admission_.in_flight_bytes());
+    metrics_.update_cache(cache_.stats());
+    if (disk_cache_) metrics_.update_disk_cache(disk_cache_->stats());
+    res.set(http::field::content_type, "text/plain");
+    res.body() = metrics_.get_prometheus_metrics();
+    res.prepare_payload();
+}
+
+void ThumbnailServer::handle_static(const Request& req, beast::string_view path, Session& session) {
+    if (path == "/") path = "/index.html";
+    const StaticAssets::Asset* asset = assets_.find(path);
+    if (!asset) {
+        return send_text(session, http::status::not_found, req.version(), req.keep_alive(), "Not Found");
+    }
+    const StaticAssets::Variant& variant = StaticAssets::select(*asset, req[http::field::accept_encoding]);
+
+    if (StaticAssets::matches(*asset, req[http::field::if_none_match])) {
+        http::response<http::empty_body> res{http::status::not_modified, req.version()};
+        res.set(http::field::etag, variant.etag);
+        res.set(http::field::cache_control, asset->cache_control);
+        res.set(http::field::vary, "Accept-Encoding");
+        res.keep_alive(req.keep_alive());
+        return session.send(std::move(res));
+    }
+
+    http::response<shared_buffer_body> res{http::status::ok, req.version()};
+    res.set(http::field::content_type, asset->content_type);
+    res.set(http::field::etag, variant.etag);
+    res.set(http::field::cache_control, asset->cache_control);
+    res.set(http::field::vary, "Accept-Encoding");
+    if (variant.content_encoding) res.set(http::field::content_encoding, variant.content_encoding);
+    res.keep_alive(req.keep_alive());
+    res.body() = variant.body;
+    session.send(std::move(res));
+}
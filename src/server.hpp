@@ -5,38 +5,191 @@
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <system_error>
 #include "thumbnail_processor.hpp"
 #include "metrics.hpp"
+#include "session.hpp"
+#include "worker_pool.hpp"
+#include "admission_control.hpp"
+#include "result_cache.hpp"
+#include "disk_cache.hpp"
+#include "mapped_file.hpp"
+#include "single_flight.hpp"
+#include "shared_buffer_body.hpp"
+#include "static_assets.hpp"
+#include "router.hpp"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
+struct ServerConfig {
+    int port = 8080;
+    int thread_count = 1;
+
+    // Threads dedicated to decoding/encoding, and how many jobs may wait for them
+    int worker_count = 1;
+    size_t max_queue = 64;
+    // Threads libvips and the AVIF/JXL encoders may use per image
+    // (0 = libvips default of one per core)
+    int encoder_threads = 0;
+
+    // Largest accepted request body
+    uint64_t body_limit = 20 * 1024 * 1024; // 20 MB
+    // Largest thumbnail that may be requested, per edge and in total
+    int max_output_edge = 2048;
+    uint64_t max_output_pixels = 4 * 1024 * 1024;
+    // Encoder settings for requests that don't choose their own, and caps on
+    // the costliest settings a request may choose
+    EncodeOptions encode_defaults;
+    int max_webp_effort = 6;
+    int max_avif_effort = 9;
+    int max_jxl_effort = 9;
+    int max_png_compression = 9;
+    bool allow_lossless = true;
+    // Uploads admitted at once (0 = worker_count + max_queue) and the body
+    // bytes they may hold between them; beyond either, uploads get a 503
+    size_t max_inflight_uploads = 0;
+    uint64_t max_inflight_bytes = 512ull * 1024 * 1024;
+    // Retry-After sent with 503 responses
+    std::chrono::seconds retry_after{1};
+
+    // Keep-alive connections are closed after this long without a request
+    std::chrono::seconds idle_timeout{30};
+    // Close a connection after serving this many requests (0 = unlimited)
+    int max_requests_per_connection = 1000;
+
+    // Memory for encoded thumbnails kept to answer repeat uploads (0 = no cache)
+    size_t cache_bytes = 256 * 1024 * 1024;
+
+    // Directory GET /thumb?path= may read originals from (empty = disabled)
+    std::string local_root;
+
+    // Directory for the persistent cache tier behind the memory cache, and
+    // its size on disk (empty = no disk tier)
+    std::string disk_cache_dir;
+    uint64_t disk_cache_bytes = 4ull * 1024 * 1024 * 1024;
+    // Threads that look thumbnails up in the disk tier and write new ones
+    // behind, apart from the processing workers
+    int disk_cache_threads = 2;
+};
+
 class ThumbnailServer {
 public:
-    ThumbnailServer(int port, int thread_count);
+    explicit ThumbnailServer(const ServerConfig& config);
     ~ThumbnailServer();
 
     void run();
     void stop();
 
+    const ServerConfig& config() const { return config_; }
+    MetricsCollector& metrics() { return metrics_; }
+
+    // Called once a request's header has arrived, before its body is read;
+    // may prepare the body for streaming. Returns false after sending a
+    // rejection if the body should not be read.
+    bool admit_request(Request& header,
+                       boost::optional<std::uint64_t> content_length,
+                       Session& session);
+
+    // Route a fully read request and send the response on the session
+    void handle_request(Request&& req, Session& session);
+
 private:
     void do_accept();
-    void handle_session(tcp::socket socket);
-    void handle_request(http::request<http::dynamic_body>& req, 
-                       http::response<http::vector_body<uint8_t>>& res);
-    void handle_upload(const http::request<http::dynamic_body>& req,
-                      http::response<http::vector_body<uint8_t>>& res,
-                      const std::string& format,
-                      int target_width,
-                      int target_height);
+    void on_accept(beast::error_code ec, tcp::socket socket);
+    // vary_accept marks responses whose format was negotiated from Accept
+    void handle_upload(Request&& req,
+                      Session& session,
+                      const ThumbnailOptions& options,
+                      bool vary_accept);
+    void handle_raw_upload(Request&& req,
+                           Session& session,
+                           const ThumbnailOptions& options,
+                           bool vary_accept);
+    // POST /upload/batch: one decode, every size x format, multipart/mixed reply
+    void handle_batch_upload(Request&& req,
+                             Session& session,
+                             std::vector<int> sizes,
+                             std::vector<std::string> formats,
+                             const EncodeOptions& encode,
+                             bool vary_accept);
+    // GET /thumb: thumbnail a file under config_.local_root, decoded from a
+    // read-only mapping of it. Files over body_limit are refused with 413.
+    void handle_local_thumbnail(Request&& req,
+                                Session& session,
+                                const QueryParams& params,
+                                ThumbnailOptions options,
+                                bool vary_accept);
+    // A local original as opened on a worker, with what was sniffed from it
+    struct LocalOriginal {
+        std::shared_ptr<const MappedFile> file; // null if error is set
+        std::error_code error;
+        std::string input_format;               // empty if not an image
+        ThumbnailOptions options;               // format negotiated if it wasn't given
+        std::chrono::steady_clock::time_point start_time; // header arrival
+        int64_t read_microseconds = 0;                    // resolving, opening and sniffing
+    };
+    // Back on the session's strand: validators, cache, admission, then the job
+    void answer_local_thumbnail(const Request& req,
+                                Session& session,
+                                LocalOriginal original,
+                                bool vary_accept);
+    // Record the read and parse stages of a fully read upload
+    void record_body_stages(const Request& req, const StageLabels& labels);
+    // Shared tail of both upload routes: validate the image and queue the
+    // job. format_settled is set once negotiate_alpha has had its say.
+    void process_upload(Request&& req,
+                        Session& session,
+                        const ThumbnailOptions& options,
+                        bool vary_accept,
+                        bool format_settled = false);
+    // Accept chose JPEG for an upload that named no format; a worker checks
+    // the image for alpha (PNG if so) before process_upload continues
+    void negotiate_alpha(Request&& req, Session& session, ThumbnailOptions options);
+
+    // One thumbnail to produce, with its input already in memory
+    struct Job {
+        ThumbnailKey key;
+        ThumbnailOptions options;
+        StageLabels labels;
+        // The image bytes, and whatever keeps them alive until the job is done
+        std::shared_ptr<const void> input;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        bool vary_accept = false;
+        std::string last_modified; // sent with the thumbnail if not empty
+        std::chrono::steady_clock::time_point start_time; // header arrival, as for failures
+        std::chrono::steady_clock::time_point input_end;
+    };
+    // Join an identical job in flight or queue this one on the worker pool;
+    // the response is sent on the session when it finishes
+    void start_job(Job job, Session& session, unsigned version, bool keep_alive);
+    // Leader side of a flight: answer from the disk tier, or hand the job to
+    // the worker pool on a miss
+    void lookup_disk(Job job);
+    void submit_processing(Job job);
+    void send_text(Session& session, http::status status, unsigned version,
+                   bool keep_alive, const std::string& message);
+    void send_overloaded(Session& session, unsigned version, bool keep_alive);
+    // Count a failed request, timed from when its header arrived
+    void record_failure(Session& session, FailureClass failure);
+    // Answer from the result cache if possible; returns true if a response was sent
+    bool try_send_cached(const Request& req, Session& session, const ThumbnailKey& key,
+                         const std::string& format, bool vary_accept,
+                         const std::string& last_modified = {});
+    // Output format for a request that didn't name one, from its Accept
+    // header and whether the image has alpha. The alpha check parses the
+    // image header, so call this from a worker.
+    std::string negotiate_output(const Request& req, const uint8_t* image, size_t size) const;
     void handle_metrics(http::response<http::string_body>& res);
-    void handle_static(const std::string& path, http::response<http::string_body>& res);
-    std::string get_static_content(const std::string& path);
+    void handle_static(const Request& req, beast::string_view path, Session& session);
 
-    int port_;
-    int thread_count_;
+    ServerConfig config_;
+    std::filesystem::path local_root_; // canonical; empty if GET /thumb is disabled
     net::io_context ioc_;
     std::unique_ptr<tcp::acceptor> acceptor_;
     std::vector<std::thread> threads_;
@@ -44,4 +197,14 @@ private:
     
     ThumbnailProcessor processor_;
     MetricsCollector metrics_;
+    AdmissionControl admission_;
+    ResultCache cache_;
+    std::unique_ptr<DiskCache> disk_cache_; // null without a disk_cache_dir
+    SingleFlight flights_;
+    StaticAssets assets_;
+    // Disk tier lookups and write-behind; null without a disk tier. Both
+    // pools submit to each other, so stop() drains them in order.
+    std::unique_ptr<WorkerPool> disk_pool_;
+    // Declared last so its jobs are joined before the processor goes away
+    WorkerPool pool_;
 }; 
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "session.hpp"
+#include "server.hpp"
+#include <boost/core/ignore_unused.hpp>
+#include <limits>
+#include "logger.hpp"
+
+Session::Session(tcp::socket&& socket, ThumbnailServer& server)
+    : stream_(std::move(socket)),
+      server_(server),
+      idle_timeout_(server.config().idle_timeout),
+      max_requests_(server.config().max_requests_per_connection) {
+}
+
+void Session::run() {
+    // Hop onto the strand before touching the stream
+    net::dispatch(stream_.get_executor(),
+                  beast::bind_front_handler(&Session::do_read, shared_from_this()));
+}
+
+void Session::do_read() {
+    parser_.emplace();
+    // The size limit is applied once the header is admitted, so an
+    // oversized Content-Length gets a proper 413 instead of a dropped connection
+    parser_->body_limit((std::numeric_limits<std::uint64_t>::max)());
+
+    // Bounds both the wait for the next keep-alive request and the read itself
+    stream_.expires_after(idle_timeout_);
+
+    // Read only the header first so the server can refuse an upload
+    // before its body is buffered
+    http::async_read_header(stream_, buffer_, *parser_,
+        beast::bind_front_handler(&Session::on_header, shared_from_this()));
+}
+
+void Session::on_header(beast::error_code ec, std::size_t bytes_transferred) {
+    boost::ignore_unused(bytes_transferred);
+
+    // Client closed the connection or went idle between requests
+    if (ec == http::error::end_of_stream || ec == beast::error::timeout) {
+        return do_close();
+    }
+    if (ec) {
+        log_warn("Session error: ", ec.message());
+        return do_close();
+    }
+    request_start_ = std::chrono::steady_clock::now();
+
+    if (!server_.admit_request(parser_->get(), parser_->content_length(), *this)) {
+        return; // the rejection has already been sent
+    }
+    parser_->body_limit(server_.config().body_limit);
+
+    // Clients that asked to wait only send the body once we agree to take it
+    if (beast::iequals(parser_->get()[http::field::expect], "100-continue")) {
+        auto cont = std::make_shared<http::response<http::empty_body>>(
+            http::status::continue_, parser_->get().version());
+        response_ = cont;
+        http::async_write(stream_, *cont,
+            [self = shared_from_this()](beast::error_code ec, std::size_t) {
+                self->response_.reset();
+                if (ec) {
+                    return self->do_close();
+                }
+                self->do_read_body();
+            });
+        return;
+    }
+
+    do_read_body();
+}
+
+void Session::do_read_body() {
+    http::async_read(stream_, buffer_, *parser_,
+        beast::bind_front_handler(&Session::on_read, shared_from_this()));
+}
+
+void Session::on_read(beast::error_code ec, std::size_t bytes_transferred) {
+    boost::ignore_unused(bytes_transferred);
+
+    // The header was accepted, so a body that never arrives in full is a failed request
+    if (ec == beast::error::timeout || ec == http::error::body_limit) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - request_start_);
+        server_.metrics().record_failure(
+            ec == beast::error::timeout ? FailureClass::timeout : FailureClass::too_large, elapsed.count());
+    }
+    if (ec == beast::error::timeout) {
+        return do_close();
+    }
+    if (ec) {
+        log_warn("Session error: ", ec.message());
+        return do_close();
+    }
+
+    server_.handle_request(parser_->release(), *this);
+}
+
+void Session::on_write(bool close, beast::error_code ec, std::size_t bytes_transferred) {
+    boost::ignore_unused(bytes_transferred);
+
+    response_.reset();
+    admission_.reset();
+    if (write_labels_) {
+        if (!ec) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - write_start_);
+            server_.metrics().record_stage(Stage::write, *write_labels_, elapsed.count());
+        }
+        write_labels_.reset();
+    }
+    if (ec) {
+        log_warn("Session error: ", ec.message());
+        return do_close();
+    }
+
+    // The response asked for the connection to end (Connection: close,
+    // HTTP/1.0 without keep-alive, or the per-connection request limit)
+    if (close) {
+        return do_close();
+    }
+
+    // Pipelined requests already sitting in buffer_ are parsed from there
+    do_read();
+}
+
+void Session::do_close() {
+    beast::error_code ec;
+    stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+}
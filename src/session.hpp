@@ -0,0 +1,87 @@
+#pragma once
+
+#include <boost/beast.hpp>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include "admission_control.hpp"
+#include "metrics.hpp"
+#include "request_body.hpp"
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+class ThumbnailServer;
+
+// Uploaded images end up in one contiguous buffer that is handed to
+// libvips in place; multipart bodies are unpacked while they stream in
+using Request = http::request<request_body>;
+
+// One HTTP connection. All handlers run on the stream's strand, so a session
+// never needs its own locking and occupies no thread while waiting on I/O.
+class Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(tcp::socket&& socket, ThumbnailServer& server);
+
+    // Start reading the first request
+    void run();
+
+    // Keep an upload's admission reserved until its response has been written
+    void hold_admission(AdmissionControl::Ticket ticket) { admission_.emplace(std::move(ticket)); }
+
+    // When the current request's header arrived
+    std::chrono::steady_clock::time_point request_start() const { return request_start_; }
+
+    // Record how long the next response takes to write, under these labels
+    void time_write(const StageLabels& labels) { write_labels_ = labels; }
+
+    // The session's strand; work finishing elsewhere posts back through this
+    beast::tcp_stream::executor_type get_executor() { return stream_.get_executor(); }
+
+    // Queue a response for writing; the session keeps it alive until the
+    // write completes. Must be called on the session's strand.
+    template <class Body>
+    void send(http::response<Body>&& msg) {
+        if (++requests_served_ >= max_requests_ && max_requests_ > 0) {
+            msg.keep_alive(false);
+        }
+        // A 304 has no body, and a Content-Length would describe the 200 it
+        // stands in for, so leave its framing headers alone
+        if (msg.result() != http::status::not_modified) {
+            msg.prepare_payload();
+        }
+
+        auto sp = std::make_shared<http::response<Body>>(std::move(msg));
+        response_ = sp;
+        write_start_ = std::chrono::steady_clock::now();
+        stream_.expires_after(idle_timeout_);
+        http::async_write(stream_, *sp,
+            beast::bind_front_handler(&Session::on_write, shared_from_this(),
+                                      sp->need_eof()));
+    }
+
+private:
+    void do_read();
+    void on_header(beast::error_code ec, std::size_t bytes_transferred);
+    void do_read_body();
+    void on_read(beast::error_code ec, std::size_t bytes_transferred);
+    void on_write(bool close, beast::error_code ec, std::size_t bytes_transferred);
+    void do_close();
+
+    beast::tcp_stream stream_;
+    beast::flat_buffer buffer_;
+    std::optional<http::request_parser<Request::body_type>> parser_;
+    std::shared_ptr<void> response_;
+    std::optional<AdmissionControl::Ticket> admission_;
+    ThumbnailServer& server_;
+    std::chrono::steady_clock::time_point request_start_;
+    std::optional<StageLabels> write_labels_;
+    std::chrono::steady_clock::time_point write_start_;
+
+    std::chrono::seconds idle_timeout_;
+    int max_requests_;
+    int requests_served_ = 0;
+};
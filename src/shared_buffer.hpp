@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <glib.h>
+
+// Immutable bytes in g_malloc'd memory, the allocator libvips uses for
+// encoded output. Handing out shared_ptrs lets one encoded thumbnail feed
+// any number of responses without copying.
+class SharedBuffer {
+public:
+    // Take ownership of a buffer returned by a vips_*save_buffer call
+    static std::shared_ptr<const SharedBuffer> adopt(void* data, size_t size) {
+        return std::shared_ptr<const SharedBuffer>(new SharedBuffer(data, size));
+    }
+
+    static std::shared_ptr<const SharedBuffer> copy(const void* data, size_t size) {
+        void* owned = g_malloc(size);
+        std::memcpy(owned, data, size);
+        return adopt(owned, size);
+    }
+
+    ~SharedBuffer() { g_free(data_); }
+
+    SharedBuffer(const SharedBuffer&) = delete;
+    SharedBuffer& operator=(const SharedBuffer&) = delete;
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(data_); }
+    size_t size() const { return size_; }
+
+private:
+    SharedBuffer(void* data, size_t size) : data_(data), size_(size) {}
+
+    void* data_;
+    size_t size_;
+};
@@ -0,0 +1,28 @@
+#include "single_flight.hpp"
+
+bool SingleFlight::join(const ThumbnailKey& key, Callback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, inserted] = flights_.try_emplace(key);
+    it->second.push_back(std::move(callback));
+    return inserted;
+}
+
+void SingleFlight::complete(const ThumbnailKey& key, const FlightResult& result) {
+    std::vector<Callback> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = flights_.find(key);
+        if (it == flights_.end()) return;
+        waiters = std::move(it->second);
+        flights_.erase(it);
+    }
+    // Later requests for the key start a new flight (or hit the cache)
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        waiters[i](result, i == 0);
+    }
+}
+
+size_t SingleFlight::in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flights_.size();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "metrics.hpp"
+#include "result_cache.hpp"
+#include "shared_buffer.hpp"
+
+// Outcome of one thumbnail computation, shared by every request that waited on it
+struct FlightResult {
+    enum class Status { ok, failed, overloaded };
+
+    Status status = Status::failed;
+    std::shared_ptr<const SharedBuffer> thumbnail;
+    ResultSource source = ResultSource::processed;
+    int64_t processing_microseconds = 0; // only for processed results
+};
+
+// Deduplicates identical thumbnail jobs while they run. The first request
+// for a key becomes the leader and does the work; requests for the same key
+// that arrive before it finishes just register a callback and are handed
+// the leader's buffer. Nothing is retained once a job completes.
+class SingleFlight {
+public:
+    // leader is true for the callback of the request that started the job,
+    // so the work is counted once however many requests shared it
+    using Callback = std::function<void(const FlightResult&, bool leader)>;
+
+    // Register interest in a key. Returns true if the caller is the leader
+    // and must eventually call complete(); either way the callback runs once
+    // the result is known.
+    bool join(const ThumbnailKey& key, Callback callback);
+
+    // Publish the leader's result to everyone waiting on the key. Callbacks
+    // run on the calling thread, after the key is released.
+    void complete(const ThumbnailKey& key, const FlightResult& result);
+
+    size_t in_flight() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const ThumbnailKey& key) const { return static_cast<size_t>(key.digest()); }
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<ThumbnailKey, std::vector<Callback>, KeyHash> flights_;
+};
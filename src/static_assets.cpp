@@ -0,0 +1,534 @@
+#include "static_assets.hpp"
+#include <brotli/encode.h>
+#include <zlib.h>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string_view>
+#include "hash.hpp"
+
+namespace {
+
+// Compressed once at startup, so spend the time for the smallest output
+std::shared_ptr<const SharedBuffer> gzip_compress(boost::beast::string_view content) {
+    z_stream stream{};
+    // 15-bit window plus 16 selects the gzip wrapper rather than zlib's
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    std::string out(deflateBound(&stream, content.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(content.data()));
+    stream.avail_in = static_cast<uInt>(content.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    int result = deflate(&stream, Z_FINISH);
+    size_t size = stream.total_out;
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        throw std::runtime_error("gzip compression failed");
+    }
+    return SharedBuffer::copy(out.data(), size);
+}
+
+std::shared_ptr<const SharedBuffer> brotli_compress(boost::beast::string_view content) {
+    size_t size = BrotliEncoderMaxCompressedSize(content.size());
+    std::string out(size, '\0');
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               content.size(), reinterpret_cast<const uint8_t*>(content.data()),
+                               &size, reinterpret_cast<uint8_t*>(&out[0]))) {
+        throw std::runtime_error("brotli compression failed");
+    }
+    return SharedBuffer::copy(out.data(), size);
+}
+
+// q-value the Accept-Encoding header gives a content coding. An explicit
+// entry beats "*"; a coding the header doesn't mention is not acceptable.
+// Without the header at all, only identity is assumed.
+double encoding_quality(boost::beast::string_view accept_encoding, boost::beast::string_view coding) {
+    double quality = 0.0;
+    int best = -1; // 0 = *, 1 = exact
+    while (!accept_encoding.empty()) {
+        auto comma = accept_encoding.find(',');
+        boost::beast::string_view entry = accept_encoding.substr(0, comma);
+        accept_encoding = comma == boost::beast::string_view::npos ? boost::beast::string_view{}
+                                                                   : accept_encoding.substr(comma + 1);
+
+        auto semicolon = entry.find(';');
+        boost::beast::string_view name = entry.substr(0, semicolon);
+        while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+        while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+
+        int specificity = -1;
+        if (boost::beast::iequals(name, coding)) specificity = 1;
+        else if (name == "*") specificity = 0;
+        if (specificity <= best) continue;
+
+        double q = 1.0;
+        if (semicolon != boost::beast::string_view::npos) {
+            auto params = entry.substr(semicolon);
+            auto qpos = params.find("q=");
+            if (qpos != boost::beast::string_view::npos) {
+                q = std::atof(std::string(params.substr(qpos + 2)).c_str());
+            }
+        }
+        best = specificity;
+        quality = q;
+    }
+    return quality;
+}
+
+bool tag_listed(boost::beast::string_view if_none_match, const std::string& etag) {
+    return if_none_match.find(etag) != boost::beast::string_view::npos;
+}
+
+// The upload page. Not content-addressed, so it is served as no-cache:
+// browsers revalidate it on every load and get a 304 while it is unchanged.
+constexpr char INDEX_HTML[] = R"(
+<!DOCTYPE html>
+<html lang='en'>
+<head>
+    <meta charset='UTF-8'>
+    <meta name='viewport' content='width=device-width, initial-scale=1.0'>
+    <title>ThumbnailGen - Fast Image Thumbnailing</title>
+    <link rel="icon" type="image/svg+xml" href="data:image/svg+xml,%3Csvg xmlns='http://www.w3.org/2000/svg' viewBox='0 0 64 64'%3E%3Ctext y='52' font-size='52'%3E🚀%3C/text%3E%3C/svg%3E">
+    <style>
+        body {
+            font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, sans-serif;
+            max-width: 600px;
+            margin: 0 auto;
+            padding: 20px;
+            background: #f5f5f5;
+        }
+        .container {
+            background: white;
+            border-radius: 14px;
+            padding: 36px 24px 28px 24px;
+            box-shadow: 0 2px 18px rgba(0,0,0,0.10);
+            margin-top: 32px;
+            transition: box-shadow 0.2s;
+        }
+        h1 {
+            color: #007bff;
+            text-align: center;
+            margin-bottom: 18px;
+            font-size: 2.1rem;
+            letter-spacing: 0.5px;
+            display: flex;
+            align-items: center;
+            justify-content: center;
+            gap: 8px;
+        }
+        .step {
+            margin-bottom: 18px;
+        }
+        .step label {
+            font-weight: 500;
+            margin-right: 8px;
+        }
+        .info {
+            font-size: 0.95em;
+            color: #666;
+            margin-left: 6px;
+            cursor: pointer;
+            border-bottom: 1px dotted #666;
+        }
+        #drop {
+            width: 100%;
+            min-height: 120px;
+            border: 2.5px dashed #007bff;
+            border-radius: 8px;
+            display: flex;
+            align-items: center;
+            justify-content: center;
+            font-size: 1.1em;
+            color: #007bff;
+            background: #f8faff;
+            margin-bottom: 10px;
+            transition: border-color 0.2s, background 0.2s;
+            outline: none;
+        }
+        #drop.dragover {
+            border-color: #0056b3;
+            background: #e6f0ff;
+        }
+        #drop:focus {
+            border-color: #0056b3;
+            background: #e6f0ff;
+        }
+        #controls {
+            display: flex;
+            gap: 18px;
+            flex-wrap: wrap;
+            align-items: center;
+            margin-bottom: 10px;
+        }
+        #controls label {
+            margin-bottom: 0;
+        }
+        select {
+            padding: 4px 8px;
+            border-radius: 4px;
+            border: 1px solid #ccc;
+            font-size: 1em;
+        }
+        #generateBtn {
+            background: #007bff;
+            color: white;
+            border: none;
+            border-radius: 6px;
+            padding: 10px 24px;
+            font-size: 1.1em;
+            cursor: pointer;
+            margin-top: 10px;
+            transition: background 0.2s;
+            display: flex;
+            align-items: center;
+            gap: 8px;
+        }
+        #generateBtn:disabled {
+            background: #b3d1ff;
+            cursor: not-allowed;
+        }
+        #generateBtn .spinner {
+            display: inline-block;
+            width: 20px;
+            height: 20px;
+            border: 3px solid #fff;
+            border-top: 3px solid #007bff;
+            border-radius: 50%;
+            animation: spin 1s linear infinite;
+        }
+        .results {
+            display: flex;
+            gap: 24px;
+            flex-wrap: wrap;
+            justify-content: center;
+            margin-top: 24px;
+            transition: opacity 0.3s;
+        }
+        .image-container {
+            text-align: center;
+            flex: 1 1 180px;
+        }
+        .image-container img {
+            max-width: 180px;
+            max-height: 180px;
+            border-radius: 6px;
+            box-shadow: 0 2px 8px rgba(0,0,0,0.08);
+            margin-bottom: 6px;
+        }
+        .image-container h3 {
+            margin: 10px 0 5px 0;
+            color: #333;
+            font-size: 1em;
+        }
+        .meta {
+            font-size: 0.95em;
+            color: #888;
+            margin-bottom: 4px;
+        }
+        .download-btn {
+            display: inline-block;
+            margin-top: 8px;
+            background: #28a745;
+            color: white;
+            padding: 6px 16px;
+            border-radius: 4px;
+            text-decoration: none;
+            font-size: 0.98em;
+            transition: background 0.2s;
+        }
+        .download-btn:hover {
+            background: #218838;
+        }
+        .stats {
+            background: #f8f9fa;
+            padding: 15px;
+            border-radius: 4px;
+            margin-top: 20px;
+            font-family: monospace;
+            font-size: 1em;
+        }
+        .error {
+            color: #dc3545;
+            background: #f8d7da;
+            padding: 10px;
+            border-radius: 4px;
+            margin: 10px 0;
+            text-align: center;
+        }
+        .success {
+            color: #28a745;
+            background: #e6f9ed;
+            padding: 10px;
+            border-radius: 4px;
+            margin: 10px 0;
+            text-align: center;
+        }
+        @media (max-width: 700px) {
+            .container { padding: 12px 2vw; }
+            .results { flex-direction: column; gap: 12px; }
+            .image-container img { max-width: 98vw; }
+        }
+        @keyframes spin { 0% { transform: rotate(0deg); } 100% { transform: rotate(360deg); } }
+    </style>
+</head>
+<body>
+    <div class="container">
+        <h1><span aria-label="rocket" role="img">🚀</span> <span>ThumbnailGen</span></h1>
+        <div class="step">
+            <label for="fileInput">1. Upload Image:</label>
+            <div id="drop" tabindex="0" aria-label="Drop an image here or click to select">Drop an image here or click to select</div>
+        </div>
+        <div class="step" id="controls">
+            <label for="format">2. Format:</label>
+            <select id="format" aria-label="Output format">
+                <option value="png">PNG</option>
+                <option value="jpeg">JPEG</option>
+                <option value="webp">WebP</option>
+            </select>
+            <span class="info" title="PNG: best for transparency. JPEG: best for photos. WebP: modern, small size.">?</span>
+            <label for="size">Size:</label>
+            <select id="size" aria-label="Thumbnail size">
+                <option value="small">Small (64x64)</option>
+                <option value="medium" selected>Medium (128x128)</option>
+                <option value="large">Large (256x256)</option>
+            </select>
+            <span class="info" title="Small: icons. Medium: previews. Large: detail.">?</span>
+        </div>
+        <button id="generateBtn" disabled aria-label="Generate Thumbnail">Generate Thumbnail</button>
+        <div id="output" class="results" aria-live="polite"></div>
+        <div id="stats" class="stats" style="display: none;"></div>
+        <div id="error" class="error" style="display: none;"></div>
+        <div id="success" class="success" style="display: none;"></div>
+    </div>
+    <script>
+        const drop = document.getElementById('drop');
+        const output = document.getElementById('output');
+        const stats = document.getElementById('stats');
+        const errorDiv = document.getElementById('error');
+        const successDiv = document.getElementById('success');
+        const formatSelect = document.getElementById('format');
+        const sizeSelect = document.getElementById('size');
+        const generateBtn = document.getElementById('generateBtn');
+        let selectedFile = null;
+        let origMeta = {};
+        // Enable button only if file is selected
+        function updateButtonState() {
+            generateBtn.disabled = !selectedFile;
+        }
+        // Keyboard navigation for drop area
+        drop.addEventListener('keydown', e => {
+            if (e.key === 'Enter' || e.key === ' ') {
+                e.preventDefault();
+                openFileDialog();
+            }
+        });
+        // Drag and drop
+        drop.addEventListener('dragover', e => {
+            e.preventDefault();
+            drop.classList.add('dragover');
+        });
+        drop.addEventListener('dragleave', e => {
+            e.preventDefault();
+            drop.classList.remove('dragover');
+        });
+        drop.addEventListener('drop', e => {
+            e.preventDefault();
+            drop.classList.remove('dragover');
+            const file = e.dataTransfer.files[0];
+            if (file) selectFile(file);
+        });
+        // Click to select
+        drop.addEventListener('click', openFileDialog);
+        function openFileDialog() {
+            const input = document.createElement('input');
+            input.type = 'file';
+            input.accept = 'image/*';
+            input.onchange = (e) => {
+                const file = e.target.files[0];
+                if (file) selectFile(file);
+            };
+            input.click();
+        }
+        function selectFile(file) {
+            selectedFile = file;
+            updateButtonState();
+            errorDiv.style.display = 'none';
+            successDiv.style.display = 'none';
+            output.innerHTML = '';
+            stats.style.display = 'none';
+            // Show original image preview and meta
+            const origURL = URL.createObjectURL(file);
+            const img = new window.Image();
+            img.onload = function() {
+                origMeta = { width: img.naturalWidth, height: img.naturalHeight, type: file.type };
+                renderOriginal(origURL, file, origMeta);
+            };
+            img.src = origURL;
+        }
+        function renderOriginal(url, file, meta) {
+            output.innerHTML = '';
+            const origContainer = document.createElement('div');
+            origContainer.className = 'image-container';
+            origContainer.innerHTML = `
+                <h3>Original (${(file.size / 1024).toFixed(1)} KB)</h3>
+                <img src="${url}" alt="Original image preview">
+                <div class="meta">${meta.type || 'Unknown type'}<br>${meta.width || '?'}×${meta.height || '?'} px</div>
+            `;
+            output.appendChild(origContainer);
+        }
+        // Generate button click
+        generateBtn.addEventListener('click', async () => {
+            if (!selectedFile) return;
+            output.innerHTML = '';
+            stats.style.display = 'none';
+            errorDiv.style.display = 'none';
+            successDiv.style.display = 'none';
+            // Show original image preview again
+            const origURL = URL.createObjectURL(selectedFile);
+            renderOriginal(origURL, selectedFile, origMeta);
+            // Show loading state
+            const loadingContainer = document.createElement('div');
+            loadingContainer.className = 'image-container';
+            loadingContainer.innerHTML = `
+                <h3>Thumbnail</h3>
+                <div style="width: 100px; height: 100px; background: #f0f0f0; display: flex; align-items: center; justify-content: center; border-radius: 4px;">
+                    <span class="spinner" aria-label="Processing"></span>
+                </div>
+            `;
+            output.appendChild(loadingContainer);
+            // Disable button and show spinner
+            generateBtn.disabled = true;
+            generateBtn.innerHTML = '<span class="spinner"></span> Generating...';
+            try {
+                const form = new FormData();
+                form.append('file', selectedFile);
+                const format = formatSelect.value;
+                const size = sizeSelect.value;
+                const url = `/upload?format=${encodeURIComponent(format)}&size=${encodeURIComponent(size)}`;
+                const start = performance.now();
+                const resp = await fetch(url, { method: 'POST', body: form });
+                const end = performance.now();
+                if (!resp.ok) {
+                    throw new Error(`HTTP ${resp.status}: ${resp.statusText}`);
+                }
+                const blob = await resp.blob();
+                const duration = end - start;
+                // Get thumbnail dimensions
+                const thumbURL = URL.createObjectURL(blob);
+                const thumbImg = new window.Image();
+                thumbImg.onload = function() {
+                    loadingContainer.innerHTML = `
+                        <h3>Thumbnail (${(blob.size / 1024).toFixed(1)} KB)</h3>
+                        <img src="${thumbURL}" alt="Thumbnail preview"><br>
+                        <div class="meta">${blob.type || 'Unknown type'}<br>${thumbImg.naturalWidth}×${thumbImg.naturalHeight} px</div>
+                        <a class="download-btn" href="${thumbURL}" download="thumbnail.${format}">Download</a>
+                    `;
+                    // Show stats
+                    stats.style.display = 'block';
+                    stats.innerHTML = `
+                        <strong>Performance Metrics:</strong><br>
+                        Total round-trip time: ${duration.toFixed(1)} ms<br>
+                        Thumbnail size: ${(blob.size / 1024).toFixed(1)} KB<br>
+                        Compression ratio: ${(selectedFile.size / blob.size).toFixed(1)}:1
+                    `;
+                    // Show success message
+                    successDiv.style.display = 'block';
+                    successDiv.textContent = 'Thumbnail generated successfully!';
+                    // Auto-scroll to results
+                    setTimeout(() => {
+                        output.scrollIntoView({ behavior: 'smooth', block: 'center' });
+                    }, 100);
+                };
+                thumbImg.src = thumbURL;
+            } catch (error) {
+                loadingContainer.innerHTML = '';
+                errorDiv.style.display = 'block';
+                errorDiv.textContent = `Error processing image: ${error.message}`;
+            } finally {
+                generateBtn.disabled = false;
+                generateBtn.innerHTML = 'Generate Thumbnail';
+            }
+        });
+        // Enable button if file is selected
+        updateButtonState();
+        // Spinner animation (for browsers that don't support @keyframes in style tag)
+        const style = document.createElement('style');
+        style.innerHTML = `@keyframes spin { 0% { transform: rotate(0deg); } 100% { transform: rotate(360deg); } }`;
+        document.head.appendChild(style);
+        // Accessibility: focus drop area on page load
+        window.onload = () => { drop.focus(); };
+    </script>
+</body>
+</html>
+)";
+
+} // namespace
+
+StaticAssets::StaticAssets() {
+    add("/index.html", "text/html; charset=utf-8", "public, no-cache", INDEX_HTML);
+}
+
+const StaticAssets::Asset* StaticAssets::find(boost::beast::string_view path) const {
+    auto it = assets_.find(std::string_view(path.data(), path.size()));
+    return it == assets_.end() ? nullptr : &it->second;
+}
+
+const StaticAssets::Variant& StaticAssets::select(const Asset& asset, boost::beast::string_view accept_encoding) {
+    const Variant* best = &asset.identity;
+    double best_quality = 0.0;
+    // Smallest first, so ties go to the better compression
+    for (const Variant* variant : {&asset.brotli, &asset.gzip}) {
+        if (!variant->body) continue;
+        double quality = encoding_quality(accept_encoding, variant->content_encoding);
+        if (quality > best_quality) {
+            best = variant;
+            best_quality = quality;
+        }
+    }
+    return *best;
+}
+
+bool StaticAssets::matches(const Asset& asset, boost::beast::string_view if_none_match) {
+    if (if_none_match.empty()) return false;
+    if (if_none_match == "*") return true;
+    for (const Variant* variant : {&asset.identity, &asset.gzip, &asset.brotli}) {
+        if (variant->body && tag_listed(if_none_match, variant->etag)) return true;
+    }
+    return false;
+}
+
+void StaticAssets::add(const std::string& path, const std::string& content_type,
+                       const std::string& cache_control, boost::beast::string_view content) {
+    Asset asset;
+    asset.content_type = content_type;
+    asset.cache_control = cache_control;
+
+    // Strong tags from the content, so they survive restarts and agree
+    // across instances; each coding is a different byte sequence and gets
+    // its own tag
+    Hasher hasher;
+    hasher.update(content.data(), content.size());
+    char tag[24];
+    std::snprintf(tag, sizeof(tag), "%016llx", static_cast<unsigned long long>(hasher.digest()));
+
+    asset.identity.body = SharedBuffer::copy(content.data(), content.size());
+    asset.identity.etag = std::string("\"") + tag + "\"";
+
+    auto gzip = gzip_compress(content);
+    if (gzip->size() < content.size()) {
+        asset.gzip.body = std::move(gzip);
+        asset.gzip.etag = std::string("\"") + tag + "-gz\"";
+    }
+    asset.gzip.content_encoding = "gzip";
+
+    auto brotli = brotli_compress(content);
+    if (brotli->size() < content.size()) {
+        asset.brotli.body = std::move(brotli);
+        asset.brotli.etag = std::string("\"") + tag + "-br\"";
+    }
+    asset.brotli.content_encoding = "br";
+
+    assets_[path] = std::move(asset);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <boost/beast/core/string.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include "shared_buffer.hpp"
+
+// The embedded web UI, built once at startup. Every asset is stored once
+// per content coding, gzip and brotli compressed ahead of time, so serving
+// one is a lookup and a shared_ptr copy. Read-only after construction, so
+// any thread may serve from it.
+class StaticAssets {
+public:
+    struct Variant {
+        std::shared_ptr<const SharedBuffer> body; // null if the coding didn't shrink the asset
+        std::string etag;                         // strong, and distinct per coding
+        const char* content_encoding = nullptr;   // null for identity
+    };
+
+    struct Asset {
+        std::string content_type;
+        std::string cache_control;
+        Variant identity;
+        Variant gzip;
+        Variant brotli;
+    };
+
+    StaticAssets();
+
+    // nullptr if there is no asset at this path
+    const Asset* find(boost::beast::string_view path) const;
+
+    // The smallest variant the Accept-Encoding header allows
+    static const Variant& select(const Asset& asset, boost::beast::string_view accept_encoding);
+
+    // Whether an If-None-Match header names any variant of the asset, so a
+    // client that changes its Accept-Encoding still gets a 304
+    static bool matches(const Asset& asset, boost::beast::string_view if_none_match);
+
+private:
+    void add(const std::string& path, const std::string& content_type,
+             const std::string& cache_control, boost::beast::string_view content);
+
+    std::map<std::string, Asset, std::less<>> assets_;
+};
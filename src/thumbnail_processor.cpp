@@ -1,117 +1,361 @@
 #include "thumbnail_processor.hpp"
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <functional>
 #include <stdexcept>
 #include <vips/vips.h>
 #include <glib.h>
+#include "logger.hpp"
 
-ThumbnailProcessor::ThumbnailProcessor() {
-    std::cout << "Initializing libvips..." << std::endl;
+namespace {
+
+[[noreturn]] void throw_vips_error(const std::string& what) {
+    std::string err = vips_error_buffer();
+    vips_error_clear();
+    throw std::runtime_error(what + ": " + err);
+}
+
+VipsForeignSubsample subsample_mode(EncodeOptions::Subsample subsample) {
+    switch (subsample) {
+    case EncodeOptions::Subsample::on:  return VIPS_FOREIGN_SUBSAMPLE_ON;
+    case EncodeOptions::Subsample::off: return VIPS_FOREIGN_SUBSAMPLE_OFF;
+    default:                            return VIPS_FOREIGN_SUBSAMPLE_AUTO;
+    }
+}
+
+// Returns nonzero on failure, like the libvips calls it wraps
+int save_to_buffer(VipsImage* image, const std::string& format, const EncodeOptions& options,
+                   void** buffer, size_t* size) {
+    if (format == "jpeg") {
+        return vips_jpegsave_buffer(image, buffer, size,
+                                    "Q", options.quality,
+                                    "strip", true,
+                                    "interlace", options.jpeg_progressive,
+                                    "optimize_coding", options.jpeg_optimize_coding,
+                                    "subsample_mode", subsample_mode(options.jpeg_subsample),
+                                    nullptr);
+    } else if (format == "webp") {
+        return vips_webpsave_buffer(image, buffer, size,
+                                    "Q", options.quality,
+                                    "effort", options.webp_effort,
+                                    "lossless", options.lossless,
+                                    nullptr);
+    } else if (format == "avif") {
+        return vips_heifsave_buffer(image, buffer, size,
+                                    "compression", VIPS_FOREIGN_HEIF_COMPRESSION_AV1,
+                                    "Q", options.quality,
+                                    "effort", options.avif_effort,
+                                    "lossless", options.lossless,
+                                    "strip", true,
+                                    nullptr);
+    } else if (format == "jxl") {
+        return vips_jxlsave_buffer(image, buffer, size,
+                                   "Q", options.quality,
+                                   "effort", options.jxl_effort,
+                                   "lossless", options.lossless,
+                                   "strip", true,
+                                   nullptr);
+    }
+    // default to PNG
+    return vips_pngsave_buffer(image, buffer, size,
+                               "compression", options.png_compression,
+                               "interlace", false,
+                               "filter", VIPS_FOREIGN_PNG_FILTER_NONE,
+                               "palette", options.png_palette,
+                               "Q", options.quality,
+                               nullptr);
+}
+
+DecodedImage own(VipsImage* image) {
+    return DecodedImage(image, [](VipsImage* p) { g_object_unref(p); });
+}
+
+// Render a lazy pipeline once, so encoders and later levels read pixels
+// instead of re-running the decode
+DecodedImage materialize(VipsImage* image) {
+    VipsImage* memory = vips_image_copy_memory(image);
+    g_object_unref(image);
+    if (!memory) {
+        throw_vips_error("Failed to render image");
+    }
+    return own(memory);
+}
+
+// Stands in for an unconstrained edge; libvips' own VIPS_MAX_COORD
+constexpr int UNBOUNDED = 10000000;
+
+VipsCompassDirection direction_for(Gravity gravity) {
+    switch (gravity) {
+    case Gravity::north:      return VIPS_COMPASS_DIRECTION_NORTH;
+    case Gravity::south:      return VIPS_COMPASS_DIRECTION_SOUTH;
+    case Gravity::east:       return VIPS_COMPASS_DIRECTION_EAST;
+    case Gravity::west:       return VIPS_COMPASS_DIRECTION_WEST;
+    case Gravity::north_east: return VIPS_COMPASS_DIRECTION_NORTH_EAST;
+    case Gravity::north_west: return VIPS_COMPASS_DIRECTION_NORTH_WEST;
+    case Gravity::south_east: return VIPS_COMPASS_DIRECTION_SOUTH_EAST;
+    case Gravity::south_west: return VIPS_COMPASS_DIRECTION_SOUTH_WEST;
+    default:                  return VIPS_COMPASS_DIRECTION_CENTRE;
+    }
+}
+
+// Gravities libvips can crop to during the thumbnail itself
+bool interesting_for(Gravity gravity, VipsInteresting* interesting) {
+    switch (gravity) {
+    case Gravity::centre:    *interesting = VIPS_INTERESTING_CENTRE; return true;
+    case Gravity::entropy:   *interesting = VIPS_INTERESTING_ENTROPY; return true;
+    case Gravity::attention: *interesting = VIPS_INTERESTING_ATTENTION; return true;
+    default:                 return false;
+    }
+}
+
+// Place (or crop) an image on an exact canvas. Transparent padding where
+// there is alpha, white otherwise.
+VipsImage* place(VipsImage* image, Gravity gravity, int width, int height) {
+    VipsImage* placed = nullptr;
+    VipsExtend extend = vips_image_hasalpha(image) ? VIPS_EXTEND_BLACK : VIPS_EXTEND_WHITE;
+    int failed = vips_gravity(image, &placed, direction_for(gravity), width, height,
+                              "extend", extend,
+                              nullptr);
+    g_object_unref(image);
+    if (failed) {
+        throw_vips_error("Failed to place thumbnail");
+    }
+    return placed;
+}
+
+// Shrink-on-load to the requested box. Every path goes through
+// vips_thumbnail_buffer so JPEG/WebP can downscale while decoding;
+// "linear" is left off since it forces a full decode.
+VipsImage* shrink(const uint8_t* image_data, size_t image_size, const ThumbnailOptions& options) {
+    void* data = const_cast<uint8_t*>(image_data);
+    int width = options.width > 0 ? options.width : UNBOUNDED;
+    int height = options.height > 0 ? options.height : UNBOUNDED;
+    Fit fit = options.width > 0 && options.height > 0 ? options.fit : Fit::inside;
+
+    VipsImage* image = nullptr;
+    int failed = 0;
+    VipsInteresting interesting;
+    if (fit == Fit::fill) {
+        failed = vips_thumbnail_buffer(data, image_size, &image, width,
+                                       "height", height,
+                                       "size", VIPS_SIZE_FORCE,
+                                       "no_rotate", true,
+                                       nullptr);
+    } else if (fit == Fit::cover && interesting_for(options.gravity, &interesting)) {
+        failed = vips_thumbnail_buffer(data, image_size, &image, width,
+                                       "height", height,
+                                       "crop", interesting,
+                                       "no_rotate", true,
+                                       nullptr);
+    } else if (fit == Fit::cover) {
+        // Compass gravity: shrink until the box is covered, then crop
+        // towards that edge. Only the header is read to size the shrink.
+        VipsImage* header = vips_image_new_from_buffer(data, image_size, "", nullptr);
+        if (!header) {
+            throw_vips_error("Failed to read image header");
+        }
+        double scale = std::max(static_cast<double>(width) / vips_image_get_width(header),
+                                static_cast<double>(height) / vips_image_get_height(header));
+        int cover_width = std::max(width, static_cast<int>(std::ceil(vips_image_get_width(header) * scale)));
+        int cover_height = std::max(height, static_cast<int>(std::ceil(vips_image_get_height(header) * scale)));
+        g_object_unref(header);
+        failed = vips_thumbnail_buffer(data, image_size, &image, cover_width,
+                                       "height", cover_height,
+                                       "no_rotate", true,
+                                       nullptr);
+        if (!failed) {
+            return place(image, options.gravity, width, height);
+        }
+    } else {
+        failed = vips_thumbnail_buffer(data, image_size, &image, width,
+                                       "height", height,
+                                       "no_rotate", true,
+                                       nullptr);
+        if (!failed && fit == Fit::contain) {
+            return place(image, options.gravity, width, height);
+        }
+    }
+    if (failed) {
+        throw_vips_error("Failed to create thumbnail");
+    }
+    return image;
+}
+
+int64_t microseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+ThumbnailProcessor::ThumbnailProcessor(int concurrency) {
     if (VIPS_INIT("thumbnail_service")) {
         throw std::runtime_error("Failed to initialize libvips");
     }
-    vips_concurrency_set(vips_concurrency_get());
+    // Also the thread count the AV1 and JPEG XL encoders are given, so
+    // workers x concurrency is what one busy server can put on the CPU
+    if (concurrency > 0) {
+        vips_concurrency_set(concurrency);
+    }
     vips_cache_set_max(0);
-    std::cout << "libvips initialized." << std::endl;
+
+    formats_ = {"jpeg", "webp", "png"};
+    for (const char* format : {"avif", "jxl"}) {
+        if (probe_format(format)) {
+            formats_.push_back(format);
+        }
+    }
+    std::string formats;
+    for (const auto& format : formats_) formats += " " + format;
+    log_info("libvips initialized (", vips_concurrency_get(), " threads per image; formats:", formats, ")");
 }
 
 ThumbnailProcessor::~ThumbnailProcessor() {
-    std::cout << "Shutting down libvips..." << std::endl;
     vips_shutdown();
-    std::cout << "libvips shutdown complete." << std::endl;
+    log_info("libvips shut down");
 }
 
-std::vector<uint8_t> ThumbnailProcessor::create_thumbnail(const std::vector<uint8_t>& image_data, 
-                                                         int target_width, 
-                                                         int target_height,
-                                                         const std::string& format) {
-    VipsImage *input = nullptr;
-    VipsImage *thumbnail = nullptr;
+std::shared_ptr<const SharedBuffer> ThumbnailProcessor::create_thumbnail(const uint8_t* image_data,
+                                                                         size_t image_size,
+                                                                         const ThumbnailOptions& options,
+                                                                         StageTimings* timings) {
     void *buffer = nullptr;
     size_t size = 0;
-    std::vector<uint8_t> result;
-
-    try {
-        std::cout << "Processing image: " << image_data.size() << " bytes" << std::endl;
-
-        std::cout << "Loading image from buffer..." << std::endl;
-        input = vips_image_new_from_buffer(
-            static_cast<const void*>(image_data.data()), 
-            image_data.size(), 
-            "", 
-            nullptr
-        );
-        if (!input) {
-            std::string err = vips_error_buffer();
-            vips_error_clear();
-            std::cerr << "Failed to load image: " << err << std::endl;
-            throw std::runtime_error("Failed to load image: " + err);
-        }
-        std::cout << "Loaded image!" << std::endl;
-
-        std::cout << "Creating thumbnail..." << std::endl;
-        if (vips_thumbnail_image(input, &thumbnail, target_width, 
-                                "height", target_height,
-                                "crop", VIPS_INTERESTING_CENTRE,
-                                "linear", true,
-                                "no_rotate", true,
-                                nullptr)) {
-            std::string err = vips_error_buffer();
-            vips_error_clear();
-            g_object_unref(input);
-            std::cerr << "Failed to create thumbnail: " << err << std::endl;
-            throw std::runtime_error("Failed to create thumbnail: " + err);
+    const std::string& format = options.format;
+
+    // Render the thumbnail before encoding so the two can be timed apart;
+    // it is already output-sized, so the copy is small
+    auto decode_start = std::chrono::steady_clock::now();
+    DecodedImage thumbnail = materialize(shrink(image_data, image_size, options));
+    auto encode_start = std::chrono::steady_clock::now();
+    if (save_to_buffer(thumbnail.get(), format, options.encode, &buffer, &size)) {
+        throw_vips_error("Failed to save " + format);
+    }
+    if (timings) {
+        timings->decode_microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+            encode_start - decode_start).count();
+        timings->encode_microseconds = microseconds_since(encode_start);
+    }
+
+    log_debug("Thumbnail: ", image_size, " bytes in, ", size, " bytes ", format, " out");
+    // The response body takes over the encoder's buffer
+    return SharedBuffer::adopt(buffer, size);
+}
+
+std::vector<PyramidLevel> ThumbnailProcessor::create_pyramid(const uint8_t* image_data,
+                                                             size_t image_size,
+                                                             std::vector<int> sizes) {
+    std::sort(sizes.begin(), sizes.end(), std::greater<int>());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+
+    std::vector<PyramidLevel> levels;
+    for (int size : sizes) {
+        auto start = std::chrono::steady_clock::now();
+        VipsImage* level = nullptr;
+        int failed;
+        if (levels.empty()) {
+            // Shrink-on-load straight to the largest size
+            failed = vips_thumbnail_buffer(const_cast<uint8_t*>(image_data), image_size,
+                                           &level, size,
+                                           "height", size,
+                                           "crop", VIPS_INTERESTING_CENTRE,
+                                           "no_rotate", true,
+                                           nullptr);
+        } else {
+            // Already square, so this is a plain downscale of the previous level.
+            // The level still carries the original's orientation tag, so keep
+            // autorotation off here too or the sizes would disagree.
+            failed = vips_thumbnail_image(levels.back().image.get(), &level, size,
+                                          "height", size,
+                                          "no_rotate", true,
+                                          nullptr);
         }
-        std::cout << "Created thumbnail!" << std::endl;
-
-        std::cout << "Saving " << format << " to buffer..." << std::endl;
-        int save_result = 1;
-        if (format == "jpeg") {
-            save_result = vips_jpegsave_buffer(thumbnail, &buffer, &size,
-                                              "Q", 90,
-                                              "strip", true,
-                                              nullptr);
-        } else if (format == "webp") {
-            save_result = vips_webpsave_buffer(thumbnail, &buffer, &size,
-                                               "Q", 90,
-                                               nullptr);
-        } else { // default to PNG
-            save_result = vips_pngsave_buffer(thumbnail, &buffer, &size,
-                                             "compression", 6,
-                                             "interlace", false,
-                                             "filter", VIPS_FOREIGN_PNG_FILTER_NONE,
-                                             nullptr);
+        if (failed) {
+            throw_vips_error("Failed to create thumbnail");
         }
-        if (save_result) {
-            std::string err = vips_error_buffer();
-            vips_error_clear();
-            g_object_unref(thumbnail);
-            g_object_unref(input);
-            std::cerr << "Failed to save " << format << ": " << err << std::endl;
-            throw std::runtime_error("Failed to save " + format + ": " + err);
+        DecodedImage image = materialize(level);
+        levels.push_back({size, std::move(image), microseconds_since(start)});
+    }
+    return levels;
+}
+
+std::shared_ptr<const SharedBuffer> ThumbnailProcessor::encode(const DecodedImage& image,
+                                                               const std::string& format,
+                                                               const EncodeOptions& options) {
+    void* buffer = nullptr;
+    size_t size = 0;
+    if (save_to_buffer(image.get(), format, options, &buffer, &size)) {
+        throw_vips_error("Failed to save " + format);
+    }
+    return SharedBuffer::adopt(buffer, size);
+}
+
+bool ThumbnailProcessor::supports_format(const std::string& format) const {
+    return std::find(formats_.begin(), formats_.end(), format) != formats_.end();
+}
+
+bool ThumbnailProcessor::probe_format(const std::string& format) {
+    const char* saver = format == "avif" ? "heifsave_buffer" : "jxlsave_buffer";
+    if (!vips_type_find("VipsOperation", saver)) {
+        return false;
+    }
+    // libheif may be built without an AV1 encoder, which only shows on use
+    VipsImage* image = nullptr;
+    if (vips_black(&image, 16, 16, "bands", 3, nullptr)) {
+        vips_error_clear();
+        return false;
+    }
+    EncodeOptions fastest;
+    fastest.avif_effort = 0;
+    fastest.jxl_effort = 1;
+    void* buffer = nullptr;
+    size_t size = 0;
+    bool ok = save_to_buffer(image, format, fastest, &buffer, &size) == 0;
+    g_object_unref(image);
+    if (buffer) g_free(buffer);
+    if (!ok) vips_error_clear();
+    return ok;
+}
+
+bool ThumbnailProcessor::has_alpha(const uint8_t* image_data, size_t image_size) const {
+    VipsImage* header = vips_image_new_from_buffer(image_data, image_size, "", nullptr);
+    if (!header) {
+        vips_error_clear();
+        return false;
+    }
+    bool alpha = vips_image_hasalpha(header);
+    g_object_unref(header);
+    return alpha;
+}
+
+bool ThumbnailProcessor::is_supported_image(const uint8_t* image_data, size_t image_size) const {
+    // Only inspects the header bytes; nothing is decoded
+    if (vips_foreign_find_load_buffer(image_data, image_size)) {
+        return true;
+    }
+    vips_error_clear();
+    return false;
+}
+
+std::string ThumbnailProcessor::input_format(const uint8_t* image_data, size_t image_size) const {
+    const char* loader = vips_foreign_find_load_buffer(image_data, image_size);
+    if (!loader) {
+        vips_error_clear();
+        return {};
+    }
+    // Loader class names look like VipsForeignLoadJpegBuffer; newer libvips
+    // builds name some after their library (Spng, Nsgif)
+    std::string name(loader);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (const char* format : {"jpeg", "png", "webp", "gif", "tiff", "heif", "jxl", "svg"}) {
+        if (name.find(format) != std::string::npos) {
+            return format;
         }
-        std::cout << "Saved " << format << "!" << std::endl;
-
-        result.assign(static_cast<uint8_t*>(buffer), static_cast<uint8_t*>(buffer) + size);
-
-        g_free(buffer);
-        g_object_unref(thumbnail);
-        g_object_unref(input);
-
-        std::cout << "Thumbnail processing complete!" << std::endl;
-        return result;
-    } catch (const std::exception& e) {
-        if (buffer) g_free(buffer);
-        if (thumbnail) g_object_unref(thumbnail);
-        if (input) g_object_unref(input);
-        std::cerr << "Thumbnail processing error: " << e.what() << std::endl;
-        throw;
-    } catch (...) {
-        if (buffer) g_free(buffer);
-        if (thumbnail) g_object_unref(thumbnail);
-        if (input) g_object_unref(input);
-        std::cerr << "Unknown thumbnail processing error" << std::endl;
-        throw std::runtime_error("Unknown error during image processing");
     }
+    return "other";
 }
 
 std::vector<uint8_t> ThumbnailProcessor::image_to_png_buffer(void* vips_image) {
@@ -1,21 +1,123 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include "shared_buffer.hpp"
+
+struct _VipsImage;
+
+// A decoded image held in memory. Safe to encode from several threads at once.
+using DecodedImage = std::shared_ptr<_VipsImage>;
+
+// One size of a batch pyramid
+struct PyramidLevel {
+    int size;
+    DecodedImage image;
+    // Time to produce this level: a decode for the first, a resize after that
+    int64_t microseconds = 0;
+};
+
+// Where create_thumbnail spent its time. libvips shrinks while it decodes,
+// so decode includes the resize to the output box.
+struct StageTimings {
+    int64_t decode_microseconds = 0;
+    int64_t encode_microseconds = 0;
+};
+
+// How the image is fitted to the requested box
+enum class Fit {
+    cover,   // fill the box, cropping the overflow
+    contain, // fit inside the box, padding to exactly its size
+    fill,    // stretch to the box, ignoring aspect ratio
+    inside   // fit inside the box; the output may be smaller
+};
+
+// Which part of the image to keep when cropping (cover) or where to place
+// it when padding (contain). entropy and attention pick the most
+// interesting region and only apply to cover.
+enum class Gravity {
+    centre, north, south, east, west,
+    north_east, north_west, south_east, south_west,
+    entropy, attention
+};
+
+// Encoder settings; each applies only to the formats named in its comment
+struct EncodeOptions {
+    enum class Subsample { automatic, on, off };
+
+    int quality = 90;              // jpeg, webp, avif, jxl (and png when palette is on), 1-100
+    int webp_effort = 4;           // webp, 0 (fastest) - 6 (smallest)
+    int avif_effort = 4;           // avif, 0 (fastest) - 9 (smallest)
+    int jxl_effort = 7;            // jxl, 1 (fastest) - 9 (smallest)
+    bool lossless = false;         // webp, avif, jxl
+    bool jpeg_progressive = false;
+    bool jpeg_optimize_coding = false;
+    Subsample jpeg_subsample = Subsample::automatic; // on = 4:2:0, off = 4:4:4
+    int png_compression = 6;       // zlib level, 0-9
+    bool png_palette = false;      // quantise to 8-bit palette
+};
+
+struct ThumbnailOptions {
+    // 0 leaves that edge unconstrained (and the fit becomes inside)
+    int width = 128;
+    int height = 128;
+    Fit fit = Fit::cover;
+    Gravity gravity = Gravity::centre;
+    std::string format = "png";
+    EncodeOptions encode;
+};
 
 class ThumbnailProcessor {
 public:
-    ThumbnailProcessor();
+    // concurrency caps the threads libvips and its encoders may use for a
+    // single image (0 keeps the libvips default of one per core)
+    explicit ThumbnailProcessor(int concurrency = 0);
     ~ThumbnailProcessor();
 
-    // Create a thumbnail from image data
-    std::vector<uint8_t> create_thumbnail(const std::vector<uint8_t>& image_data, 
-                                         int target_width, 
-                                         int target_height,
-                                         const std::string& format);
+    // Create a thumbnail from image data. The input is only read during the
+    // call; the result is the encoder's own buffer, not a copy. Fills in
+    // timings when given.
+    std::shared_ptr<const SharedBuffer> create_thumbnail(const uint8_t* image_data,
+                                                         size_t image_size,
+                                                         const ThumbnailOptions& options,
+                                                         StageTimings* timings = nullptr);
+
+    // Decode once and produce a square thumbnail for each size, largest
+    // first. Each level is downscaled from the one before it rather than
+    // from the original, so only the first step touches the full image.
+    std::vector<PyramidLevel> create_pyramid(const uint8_t* image_data,
+                                             size_t image_size,
+                                             std::vector<int> sizes);
+
+    // Encode a decoded image; the result is the encoder's own buffer
+    std::shared_ptr<const SharedBuffer> encode(const DecodedImage& image,
+                                               const std::string& format,
+                                               const EncodeOptions& options);
+
+    // Output formats this libvips build can encode: jpeg, webp and png
+    // always, avif and jxl when the encoders are present
+    const std::vector<std::string>& formats() const { return formats_; }
+    bool supports_format(const std::string& format) const;
+
+    // True if the image has an alpha channel; only the header is read
+    bool has_alpha(const uint8_t* image_data, size_t image_size) const;
+
+    // True if libvips recognises the data as an image it can load
+    bool is_supported_image(const uint8_t* image_data, size_t image_size) const;
+
+    // Short name of the loader libvips would use ("jpeg", "png", "gif", ...),
+    // or empty if the data is not a supported image; only the header is read
+    std::string input_format(const uint8_t* image_data, size_t image_size) const;
 
 private:
+    // Encode a tiny image to see whether an optional encoder really works
+    bool probe_format(const std::string& format);
+
+    std::vector<std::string> formats_;
+
     // Helper method to convert vips image to PNG buffer
     std::vector<uint8_t> image_to_png_buffer(void* vips_image);
 }; 
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads for CPU-bound image work, kept apart from the
+// network threads so a slow decode never stalls socket I/O. The queue is
+// bounded so the number of images held in memory stays predictable.
+class WorkerPool {
+public:
+    WorkerPool(int thread_count, size_t max_queue);
+    ~WorkerPool();
+
+    // Queue a job; returns false without queuing if the queue is full
+    bool try_submit(std::function<void()> job);
+
+    // Finish queued jobs and join the threads
+    void stop();
+
+    size_t queue_depth() const;
+    size_t max_queue() const { return max_queue_; }
+    int thread_count() const { return static_cast<int>(threads_.size()); }
+
+private:
+    void worker_loop();
+
+    size_t max_queue_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    bool stopping_ = false;
+};